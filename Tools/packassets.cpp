@@ -0,0 +1,304 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Packs the files of the asset directory into the memory mappable bundle read by assetbundle.h.
+// PNG images get decoded to RGBA, ship*.png images are also extruded into a mesh stored as
+// ship*.mesh, zip files get inflated and stored under their name without the .zip extension,
+// everything else is stored as is.
+// Usage: packassets output.assets Data
+
+#include "../assetbundle.h"
+#include <zlib.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+typedef std::vector<unsigned char> Bytes;
+
+struct sPackAsset
+{
+	std::string Name;
+	unsigned int Type, Width, Height;
+	Bytes Data;
+	bool operator<(const sPackAsset& o) const { return Name < o.Name; }
+};
+
+static unsigned int ReadBE32(const unsigned char* p) { return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3]; }
+static unsigned int ReadLE32(const unsigned char* p) { return ((unsigned int)p[3] << 24) | ((unsigned int)p[2] << 16) | ((unsigned int)p[1] << 8) | p[0]; }
+static unsigned int ReadLE16(const unsigned char* p) { return ((unsigned int)p[1] << 8) | p[0]; }
+
+static bool ReadFile(const std::string& Path, Bytes& Out)
+{
+	FILE* f = fopen(Path.c_str(), "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	Out.resize((size_t)ftell(f));
+	fseek(f, 0, SEEK_SET);
+	const bool Ok = (Out.empty() || fread(&Out[0], 1, Out.size(), f) == Out.size());
+	fclose(f);
+	return Ok;
+}
+
+//Inflates a zlib stream (WindowBits 15) or a raw deflate stream (WindowBits -15) of known size
+static bool Inflate(const unsigned char* In, size_t InSize, int WindowBits, Bytes& Out)
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, WindowBits) != Z_OK) return false;
+	z.next_in = (Bytef*)In;
+	z.avail_in = (uInt)InSize;
+	z.next_out = &Out[0];
+	z.avail_out = (uInt)Out.size();
+	const int Res = inflate(&z, Z_FINISH);
+	inflateEnd(&z);
+	return (Res == Z_STREAM_END && z.avail_out == 0);
+}
+
+//Decodes a non-interlaced 8-bit PNG of any color type to RGBA rows (top row first)
+static bool DecodePNG(const Bytes& File, sPackAsset& Out)
+{
+	static const unsigned char Signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	if (File.size() < 8 || memcmp(&File[0], Signature, 8)) return false;
+	unsigned int Width = 0, Height = 0, ColorType = 0, Channels = 0;
+	Bytes Compressed, Palette, PaletteAlpha;
+	for (size_t Pos = 8; Pos + 12 <= File.size();)
+	{
+		const unsigned int Len = ReadBE32(&File[Pos]);
+		if (Len > File.size() - Pos - 12) return false;
+		const unsigned char *Type = &File[Pos + 4], *Chunk = &File[Pos + 8];
+		if (!memcmp(Type, "IHDR", 4))
+		{
+			if (Len < 13) return false;
+			Width = ReadBE32(Chunk);
+			Height = ReadBE32(Chunk + 4);
+			ColorType = Chunk[9];
+			if (Chunk[8] != 8 || Chunk[12] != 0) { fprintf(stderr, "Only 8-bit non-interlaced PNG files are supported\n"); return false; }
+			Channels = (ColorType == 0 || ColorType == 3 ? 1 : ColorType == 2 ? 3 : ColorType == 4 ? 2 : ColorType == 6 ? 4 : 0);
+		}
+		else if (!memcmp(Type, "PLTE", 4)) Palette.assign(Chunk, Chunk + Len);
+		else if (!memcmp(Type, "tRNS", 4)) PaletteAlpha.assign(Chunk, Chunk + Len);
+		else if (!memcmp(Type, "IDAT", 4)) Compressed.insert(Compressed.end(), Chunk, Chunk + Len);
+		else if (!memcmp(Type, "IEND", 4)) break;
+		Pos += 12 + Len;
+	}
+	if (!Width || !Height || !Channels || Compressed.empty() || (ColorType == 3 && Palette.empty())) return false;
+
+	const size_t Stride = (size_t)Width * Channels;
+	Bytes Raw((Stride + 1) * Height);
+	if (!Inflate(&Compressed[0], Compressed.size(), 15, Raw)) return false;
+
+	Bytes Pixels(Stride * Height);
+	for (unsigned int y = 0; y < Height; y++)
+	{
+		const unsigned char Filter = Raw[y * (Stride + 1)], *In = &Raw[y * (Stride + 1) + 1];
+		unsigned char *Row = &Pixels[y * Stride], *Prev = (y ? Row - Stride : NULL);
+		for (size_t i = 0; i < Stride; i++)
+		{
+			const int a = (i >= Channels ? Row[i - Channels] : 0), b = (Prev ? Prev[i] : 0), c = (Prev && i >= Channels ? Prev[i - Channels] : 0);
+			int Predict = 0;
+			switch (Filter)
+			{
+				case 0: break;
+				case 1: Predict = a; break;
+				case 2: Predict = b; break;
+				case 3: Predict = (a + b) / 2; break;
+				case 4: { const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c); Predict = (pa <= pb && pa <= pc ? a : pb <= pc ? b : c); break; }
+				default: return false;
+			}
+			Row[i] = (unsigned char)(In[i] + Predict);
+		}
+	}
+
+	Out.Type = ASSET_RGBA;
+	Out.Width = Width;
+	Out.Height = Height;
+	Out.Data.resize((size_t)Width * Height * 4);
+	for (size_t i = 0, n = (size_t)Width * Height; i < n; i++)
+	{
+		const unsigned char* s = &Pixels[i * Channels];
+		unsigned char* d = &Out.Data[i * 4];
+		switch (ColorType)
+		{
+			case 0: d[0] = d[1] = d[2] = s[0]; d[3] = 255; break;
+			case 2: d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = 255; break;
+			case 3:
+				if (s[0] * 3u + 3 > Palette.size()) return false;
+				memcpy(d, &Palette[s[0] * 3], 3);
+				d[3] = (s[0] < PaletteAlpha.size() ? PaletteAlpha[s[0]] : 255);
+				break;
+			case 4: d[0] = d[1] = d[2] = s[0]; d[3] = s[1]; break;
+			case 6: memcpy(d, s, 4); break;
+		}
+	}
+	return true;
+}
+
+enum { EXTRUDE_ALPHA = 128 };
+static const float ExtrudeScale = .05f, ExtrudeDepth = .1f; //same as the ZL_Mesh::BuildExtrudePixels call this replaces
+
+static bool IsSolid(const sPackAsset& Image, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= (int)Image.Width || y >= (int)Image.Height) return false;
+	return Image.Data[(y * Image.Width + x) * 4 + 3] >= EXTRUDE_ALPHA;
+}
+
+static void AddQuad(std::vector<sAssetMeshVertex>& Vertices, std::vector<unsigned short>& Indices, const float (*Corners)[3], float nx, float ny, float nz, const unsigned char* Color)
+{
+	const unsigned short First = (unsigned short)Vertices.size();
+	for (int i = 0; i < 4; i++)
+	{
+		sAssetMeshVertex v = { { Corners[i][0], Corners[i][1], Corners[i][2] }, { nx, ny, nz }, { Color[0], Color[1], Color[2], 255 } };
+		Vertices.push_back(v);
+	}
+	const unsigned short Quad[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int i = 0; i < 6; i++) Indices.push_back((unsigned short)(First + Quad[i]));
+}
+
+//Extrudes every pixel with enough alpha into a flat shaded box in its color, centered on the image with y up
+static bool ExtrudePixels(const sPackAsset& Image, sPackAsset& Out)
+{
+	std::vector<sAssetMeshVertex> Vertices;
+	std::vector<unsigned short> Indices;
+	const float z0 = -ExtrudeDepth * .5f, z1 = ExtrudeDepth * .5f;
+	for (int y = 0; y < (int)Image.Height; y++)
+		for (int x = 0; x < (int)Image.Width; x++)
+		{
+			if (!IsSolid(Image, x, y)) continue;
+			const unsigned char* Color = &Image.Data[(y * Image.Width + x) * 4];
+			const float x0 = (x - Image.Width * .5f) * ExtrudeScale, x1 = x0 + ExtrudeScale, y1 = (Image.Height * .5f - y) * ExtrudeScale, y0 = y1 - ExtrudeScale;
+			const float Front[4][3]  = { { x0, y0, z1 }, { x1, y0, z1 }, { x1, y1, z1 }, { x0, y1, z1 } };
+			const float Back[4][3]   = { { x0, y0, z0 }, { x0, y1, z0 }, { x1, y1, z0 }, { x1, y0, z0 } };
+			const float Left[4][3]   = { { x0, y0, z0 }, { x0, y0, z1 }, { x0, y1, z1 }, { x0, y1, z0 } };
+			const float Right[4][3]  = { { x1, y0, z0 }, { x1, y1, z0 }, { x1, y1, z1 }, { x1, y0, z1 } };
+			const float Top[4][3]    = { { x0, y1, z0 }, { x0, y1, z1 }, { x1, y1, z1 }, { x1, y1, z0 } };
+			const float Bottom[4][3] = { { x0, y0, z0 }, { x1, y0, z0 }, { x1, y0, z1 }, { x0, y0, z1 } };
+			AddQuad(Vertices, Indices, Front, 0, 0, 1, Color);
+			AddQuad(Vertices, Indices, Back, 0, 0, -1, Color);
+			if (!IsSolid(Image, x - 1, y)) AddQuad(Vertices, Indices, Left, -1, 0, 0, Color);
+			if (!IsSolid(Image, x + 1, y)) AddQuad(Vertices, Indices, Right, 1, 0, 0, Color);
+			if (!IsSolid(Image, x, y - 1)) AddQuad(Vertices, Indices, Top, 0, 1, 0, Color);
+			if (!IsSolid(Image, x, y + 1)) AddQuad(Vertices, Indices, Bottom, 0, -1, 0, Color);
+			if (Vertices.size() > 65536 - 24) { fprintf(stderr, "Too many solid pixels to extrude\n"); return false; }
+		}
+	Out.Type = ASSET_MESH;
+	Out.Width = (unsigned int)Vertices.size();
+	Out.Height = (unsigned int)Indices.size();
+	Out.Data.resize(Vertices.size() * sizeof(sAssetMeshVertex) + Indices.size() * 2);
+	if (!Vertices.empty()) memcpy(&Out.Data[0], &Vertices[0], Vertices.size() * sizeof(sAssetMeshVertex));
+	if (!Indices.empty()) memcpy(&Out.Data[Vertices.size() * sizeof(sAssetMeshVertex)], &Indices[0], Indices.size() * 2);
+	return true;
+}
+
+//Extracts the single file stored in a zip archive (like the font)
+static bool Unzip(const Bytes& File, sPackAsset& Out)
+{
+	//find the end of central directory record and read the first central directory entry
+	size_t End = File.size();
+	if (End < 22) return false;
+	for (End -= 22; End && ReadLE32(&File[End]) != 0x06054b50; End--) { }
+	if (ReadLE32(&File[End]) != 0x06054b50 || ReadLE16(&File[End + 10]) != 1) return false;
+	const size_t Central = ReadLE32(&File[End + 16]);
+	if (Central + 46 > End || ReadLE32(&File[Central]) != 0x02014b50) return false;
+	const unsigned int Method = ReadLE16(&File[Central + 10]), CompSize = ReadLE32(&File[Central + 20]), Size = ReadLE32(&File[Central + 24]);
+	const size_t Local = ReadLE32(&File[Central + 42]);
+	if (Local + 30 > Central || ReadLE32(&File[Local]) != 0x04034b50) return false;
+	const size_t Start = Local + 30 + ReadLE16(&File[Local + 26]) + ReadLE16(&File[Local + 28]);
+	if (Start > Central || CompSize > Central - Start) return false;
+
+	Out.Type = ASSET_FILE;
+	Out.Width = Out.Height = 0;
+	if (Method == 0 && CompSize == Size) { Out.Data.assign(&File[Start], &File[Start] + Size); return true; }
+	Out.Data.resize(Size);
+	return (Method == 8 && Size && Inflate(&File[Start], CompSize, -15, Out.Data));
+}
+
+static bool EndsWith(const std::string& s, const char* Suffix)
+{
+	const size_t n = strlen(Suffix);
+	return (s.size() >= n && !s.compare(s.size() - n, n, Suffix));
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) { fprintf(stderr, "Usage: %s output.assets Data\n", argv[0]); return 1; }
+	const std::string Dir = argv[2];
+	DIR* d = opendir(Dir.c_str());
+	if (!d) { fprintf(stderr, "Could not open directory %s\n", Dir.c_str()); return 1; }
+
+	std::vector<sPackAsset> Assets;
+	for (struct dirent* e; (e = readdir(d)) != NULL;)
+	{
+		if (e->d_name[0] == '.') continue;
+		sPackAsset a;
+		a.Name = Dir + "/" + e->d_name;
+		Bytes File;
+		if (!ReadFile(a.Name, File)) { fprintf(stderr, "Could not read %s\n", a.Name.c_str()); closedir(d); return 1; }
+		bool Ok = true;
+		if (EndsWith(a.Name, ".png")) Ok = DecodePNG(File, a);
+		else if (EndsWith(a.Name, ".zip")) { Ok = Unzip(File, a); a.Name.resize(a.Name.size() - 4); }
+		else { a.Type = ASSET_FILE; a.Width = a.Height = 0; a.Data.swap(File); }
+		if (!Ok) { fprintf(stderr, "Could not decode %s\n", a.Name.c_str()); closedir(d); return 1; }
+		if (a.Name.size() >= ASSETBUNDLE_NAME) { fprintf(stderr, "Asset name %s is too long\n", a.Name.c_str()); closedir(d); return 1; }
+		Assets.push_back(a);
+		if (a.Type == ASSET_RGBA && !strncmp(e->d_name, "ship", 4))
+		{
+			sPackAsset m;
+			m.Name = a.Name.substr(0, a.Name.size() - 4) + ".mesh";
+			if (!ExtrudePixels(a, m)) { fprintf(stderr, "Could not extrude %s\n", a.Name.c_str()); closedir(d); return 1; }
+			Assets.push_back(m);
+		}
+	}
+	closedir(d);
+	std::sort(Assets.begin(), Assets.end());
+
+	sAssetBundleHeader Header = { ASSETBUNDLE_MAGIC, ASSETBUNDLE_VERSION, (unsigned int)Assets.size(), 0 };
+	std::vector<sAssetEntry> Entries(Assets.size());
+	size_t Offset = sizeof(Header) + sizeof(sAssetEntry) * Entries.size();
+	for (size_t i = 0; i < Assets.size(); i++)
+	{
+		Offset = (Offset + ASSETBUNDLE_ALIGN - 1) / ASSETBUNDLE_ALIGN * ASSETBUNDLE_ALIGN;
+		sAssetEntry& e = Entries[i];
+		memset(&e, 0, sizeof(e));
+		strcpy(e.Name, Assets[i].Name.c_str());
+		e.Type = Assets[i].Type;
+		e.Offset = (unsigned int)Offset;
+		e.Size = (unsigned int)Assets[i].Data.size();
+		e.Width = Assets[i].Width;
+		e.Height = Assets[i].Height;
+		Offset += e.Size;
+	}
+	Header.Size = (unsigned int)Offset;
+
+	Bytes Out(Offset, 0);
+	memcpy(&Out[0], &Header, sizeof(Header));
+	if (!Entries.empty()) memcpy(&Out[sizeof(Header)], &Entries[0], sizeof(sAssetEntry) * Entries.size());
+	for (size_t i = 0; i < Assets.size(); i++)
+		if (!Assets[i].Data.empty()) memcpy(&Out[Entries[i].Offset], &Assets[i].Data[0], Assets[i].Data.size());
+
+	FILE* f = fopen(argv[1], "wb");
+	if (!f || fwrite(&Out[0], 1, Out.size(), f) != Out.size()) { fprintf(stderr, "Could not write %s\n", argv[1]); if (f) fclose(f); return 1; }
+	fclose(f);
+	printf("Packed %d assets into %s (%d bytes)\n", (int)Assets.size(), argv[1], (int)Out.size());
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Headless batch runner playing many seeded galaxies with a fixed policy to
+// measure win rate and power curves for balancing.
+// Usage: simulate [-runs N] [-threads N] [-seed N] [-policy straight|random|greedy|safe]
+//                 [-powerstart F] [-goal F] [-drain F]
+//        simulate -replay recording.txt (replays a game recorded with -record and verifies its result)
+
+#include "../simulation.h"
+#include "../replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
+
+typedef int (*PolicyFunc)(const sSimulation& Sim, sSimRand& Rand);
+
+static float ExpectedGain(const sSimulation& Sim, int Planet)
+{
+	const sSimPlanetInfo& p = Sim.Planets.Info[Planet];
+	//a gain/loss happens if chance >= RAND(0,100) and is then uniform in [10,100]
+	const float PowerProb = (p.ChancePower + 1) / 101.f, EnemyProb = (p.ChanceEnemy + 1) / 101.f;
+	return (PowerProb - EnemyProb) * 55.f - Sim.CalcTravel(Planet).DrainExtra;
+}
+
+static int PolicyStraight(const sSimulation&, sSimRand&)
+{
+	return -1;
+}
+
+static int PolicyRandom(const sSimulation& Sim, sSimRand& Rand)
+{
+	if (Rand.Int(0, 4)) return -1;
+	int Candidates[64], Count = 0, First, End;
+	Sim.VisitableRange(First, End);
+	for (int i = First; i < End && Count < 64; i++)
+		if (Sim.IsVisitable(i)) Candidates[Count++] = i;
+	return (Count ? Candidates[Rand.Int(0, Count - 1)] : -1);
+}
+
+static int PolicyGreedy(const sSimulation& Sim, sSimRand&)
+{
+	if (Sim.Power > Sim.Params.PowerStart * .7f) return -1;
+	int Best = -1, First, End;
+	float BestGain = 0;
+	Sim.VisitableRange(First, End);
+	for (int i = First; i < End; i++)
+	{
+		if (!Sim.IsVisitable(i)) continue;
+		const float Gain = ExpectedGain(Sim, i);
+		if (Gain > BestGain) { Best = i; BestGain = Gain; }
+	}
+	return Best;
+}
+
+static int PolicySafe(const sSimulation& Sim, sSimRand&)
+{
+	int Best = -1, First, End;
+	float BestGain = 0;
+	Sim.VisitableRange(First, End);
+	for (int i = First; i < End; i++)
+	{
+		if (!Sim.IsVisitable(i) || Sim.Planets.Info[i].ChanceEnemy) continue;
+		const float Gain = ExpectedGain(Sim, i);
+		if (Gain > BestGain && Sim.CalcTravel(i).DrainExtra < Sim.Power * .5f) { Best = i; BestGain = Gain; }
+	}
+	return Best;
+}
+
+static const struct { const char* Name; PolicyFunc Func; } Policies[] =
+{
+	{ "straight", PolicyStraight }, { "random", PolicyRandom }, { "greedy", PolicyGreedy }, { "safe", PolicySafe },
+};
+
+enum { CURVE_STEP = 10, MAX_CURVE = 256 };
+
+struct sStats
+{
+	long long Runs, Wins, Losses, Landings;
+	double WinTime, LoseTime, WinPower;
+	int CurveSize;
+	double CurveAll[MAX_CURVE], CurveWin[MAX_CURVE];
+	sStats() { memset(this, 0, sizeof(*this)); }
+	void Merge(const sStats& o)
+	{
+		Runs += o.Runs; Wins += o.Wins; Losses += o.Losses; Landings += o.Landings;
+		WinTime += o.WinTime; LoseTime += o.LoseTime; WinPower += o.WinPower;
+		for (int i = 0; i < CurveSize; i++) { CurveAll[i] += o.CurveAll[i]; CurveWin[i] += o.CurveWin[i]; }
+	}
+};
+
+//Plays one galaxy by jumping from one decision point to the next instead of stepping frames
+static void RunGame(sSimulation& Sim, unsigned int Seed, PolicyFunc Policy, sStats& Stats)
+{
+	Sim.Start(Seed);
+	sSimRand PolicyRand(Seed ^ 0x5BD1E995u);
+	float Time = 0, Curve[MAX_CURVE];
+	int CurveNext = 0, EnterCursor = 0, LeaveCursor = 0, PlanetCount = Sim.Planets.Size() - 1; //skip home planet
+	eSimEvent Event = SIMEVENT_NONE;
+	for (int Iteration = 0; Iteration < 10000 && Event != SIMEVENT_WIN && Event != SIMEVENT_LOSE; Iteration++)
+	{
+		if (Sim.TravelPlanet < 0)
+		{
+			const int Visit = Policy(Sim, PolicyRand);
+			if (Visit >= 0 && Sim.IsVisitable(Visit)) Sim.Visit(Visit);
+		}
+
+		//move until the next z where the power curve is sampled or the set of visitable planets changes
+		float NextZ = (CurveNext < Stats.CurveSize ? (CurveNext + 1.f) * CURVE_STEP : 1.e30f);
+		if (Sim.TravelPlanet < 0)
+		{
+			//planets are sorted by z so the next planets entering and leaving the visitable window are found by advancing a cursor
+			const float* Z = &Sim.Planets.Z[0];
+			while (EnterCursor < PlanetCount && Z[EnterCursor] - 35.f <= Sim.Pos.z) EnterCursor++;
+			while (LeaveCursor < PlanetCount && Z[LeaveCursor] -  3.f <= Sim.Pos.z) LeaveCursor++;
+			if (EnterCursor < PlanetCount && Z[EnterCursor] - 35.f < NextZ) NextZ = Z[EnterCursor] - 35.f;
+			if (LeaveCursor < PlanetCount && Z[LeaveCursor] -  3.f < NextZ) NextZ = Z[LeaveCursor] -  3.f;
+		}
+		const float Move = (Sim.Dir.z > SimSmallNumber ? (NextZ - Sim.Pos.z) / Sim.Dir.z + 1.e-3f : Sim.Distance);
+		const sSimVec3 PosBefore = Sim.Pos;
+		const bool Traveling = (Sim.TravelPlanet >= 0);
+		Event = Sim.Step(Move);
+		Time += (Sim.Pos - PosBefore).GetLength() / (Traveling ? 4.f : 2.f);
+		while (CurveNext < Stats.CurveSize && Sim.Pos.z >= (CurveNext + 1.f) * CURVE_STEP) Curve[CurveNext++] = Sim.Power;
+		if (Event == SIMEVENT_LANDED) { Stats.Landings++; Sim.Continue(); }
+	}
+	while (CurveNext < Stats.CurveSize) Curve[CurveNext++] = Sim.Power;
+
+	Stats.Runs++;
+	if (Event == SIMEVENT_WIN) { Stats.Wins++; Stats.WinTime += Time; Stats.WinPower += Sim.Power; }
+	else { Stats.Losses++; Stats.LoseTime += Time; }
+	for (int i = 0; i < Stats.CurveSize; i++)
+	{
+		Stats.CurveAll[i] += Curve[i];
+		if (Event == SIMEVENT_WIN) Stats.CurveWin[i] += Curve[i];
+	}
+}
+
+static void RunBatch(sSimParams Params, PolicyFunc Policy, unsigned int BaseSeed, long long First, long long Count, sStats* Stats)
+{
+	sSimulation Sim;
+	Sim.Params = Params;
+	Sim.Planets.Reserve(256);
+	for (long long i = First; i < First + Count; i++)
+		RunGame(Sim, BaseSeed + (unsigned int)i * 0x9E3779B9u, Policy, *Stats);
+}
+
+static int Replay(const char* Path)
+{
+	sRecording Rec;
+	if (!Rec.Load(Path)) { fprintf(stderr, "Could not load recording %s\n", Path); return 1; }
+	sSimulation Sim;
+	unsigned int Steps;
+	std::chrono::high_resolution_clock::time_point TimeStart = std::chrono::high_resolution_clock::now();
+	eSimEvent Event;
+	const bool Match = VerifyRecording(Sim, Rec, Event, Steps);
+	const double Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - TimeStart).count();
+	const char* EventName = (Event == SIMEVENT_WIN ? "win" : (Event == SIMEVENT_LOSE ? "lose" : "none"));
+	printf("Seed: %u - Events: %d - Result: %s - Steps: %u (%.1fs game time) - Power: %g - Time: %.3fs\n", Rec.Seed, (int)Rec.Events.size(), EventName, Steps, Steps * SimStepSeconds, Sim.Power, Seconds);
+	if (!Match)
+	{
+		printf("MISMATCH - recorded result %d after %u steps with power %g\n", Rec.ResultEvent, Rec.ResultSteps, Rec.ResultPower);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && !strcmp(argv[1], "-replay")) return Replay(argv[2]);
+
+	long long Runs = 1000000;
+	unsigned int Threads = std::thread::hardware_concurrency(), Seed = 1;
+	const char* PolicyName = "greedy";
+	sSimParams Params;
+	for (int i = 1; i < argc - 1; i += 2)
+	{
+		if      (!strcmp(argv[i], "-runs"))       Runs = atoll(argv[i+1]);
+		else if (!strcmp(argv[i], "-threads"))    Threads = (unsigned int)atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-seed"))       Seed = (unsigned int)strtoul(argv[i+1], NULL, 0);
+		else if (!strcmp(argv[i], "-policy"))     PolicyName = argv[i+1];
+		else if (!strcmp(argv[i], "-powerstart")) Params.PowerStart = (float)atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-goal"))       Params.GoalDistance = (float)atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-drain"))      Params.TravelDrainFactor = (float)atof(argv[i+1]);
+		else { fprintf(stderr, "Unknown option %s\n", argv[i]); return 1; }
+	}
+	if (Threads < 1) Threads = 1;
+	if (Runs < 1) Runs = 1;
+
+	PolicyFunc Policy = NULL;
+	for (size_t i = 0; i < sizeof(Policies)/sizeof(Policies[0]); i++)
+		if (!strcmp(Policies[i].Name, PolicyName)) Policy = Policies[i].Func;
+	if (!Policy) { fprintf(stderr, "Unknown policy %s\n", PolicyName); return 1; }
+
+	std::vector<sStats> ThreadStats(Threads);
+	std::vector<std::thread> Workers;
+	const int CurveSize = (int)(Params.GoalDistance / CURVE_STEP);
+	std::chrono::high_resolution_clock::time_point TimeStart = std::chrono::high_resolution_clock::now();
+	for (unsigned int t = 0; t < Threads; t++)
+	{
+		ThreadStats[t].CurveSize = (CurveSize < MAX_CURVE ? CurveSize : MAX_CURVE);
+		const long long First = Runs * t / Threads, Count = Runs * (t + 1) / Threads - First;
+		Workers.push_back(std::thread(RunBatch, Params, Policy, Seed, First, Count, &ThreadStats[t]));
+	}
+	sStats Total;
+	Total.CurveSize = ThreadStats[0].CurveSize;
+	for (unsigned int t = 0; t < Threads; t++) { Workers[t].join(); Total.Merge(ThreadStats[t]); }
+	const double Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - TimeStart).count();
+
+	printf("Policy: %s - Runs: %lld - Threads: %u - Time: %.2fs (%.0f runs/sec)\n", PolicyName, Total.Runs, Threads, Seconds, Total.Runs / Seconds);
+	printf("PowerStart: %g - GoalDistance: %g - TravelDrainFactor: %g\n", Params.PowerStart, Params.GoalDistance, Params.TravelDrainFactor);
+	printf("Win rate: %.2f%% - Avg landings per run: %.2f\n", 100.0 * Total.Wins / Total.Runs, (double)Total.Landings / Total.Runs);
+	if (Total.Wins)   printf("Avg time to win: %.1fs - Avg power at home: %.1f\n", Total.WinTime / Total.Wins, Total.WinPower / Total.Wins);
+	if (Total.Losses) printf("Avg time to lose: %.1fs\n", Total.LoseTime / Total.Losses);
+	printf("Power curve (distance, avg power of all runs, avg power of winning runs):\n");
+	for (int i = 0; i < Total.CurveSize; i++)
+		printf("%5d %8.2f %8.2f\n", (i + 1) * CURVE_STEP, Total.CurveAll[i] / Total.Runs, (Total.Wins ? Total.CurveWin[i] / Total.Wins : 0.0));
+	return 0;
+}
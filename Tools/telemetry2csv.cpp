@@ -0,0 +1,83 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Converts the rotating gameplay telemetry logs written by telemetry.h into CSV on stdout.
+// Pass the oldest file first to get the records in order.
+// Usage: telemetry2csv CosmicInflux.telemetry.3 CosmicInflux.telemetry.2 ...
+
+#include "../telemetry.h"
+#include <stdio.h>
+#include <vector>
+
+//eTelemetryType order, the columns after the name are step, mode, planet, power and Value[0..3]:
+static const char* TelemetryTypeNames[TELEMETRY_TYPES] =
+{
+	"run",      //seed as planet, power, endless, planet count, ship variant
+	"scan",     //planet, power, chance power, chance enemy, distance, extra travel drain
+	"visit",    //planet, power
+	"ignore",   //planet, power
+	"abort",    //planet, power
+	"continue", //planet, power
+	"landed",   //planet, power after, power before, gain by power, loss by enemy
+	"win",      //-, power, seconds played, distance traveled
+	"lose",     //-, power, seconds played, distance traveled
+	"frames",   //-, power, frame count, mean ms, max ms, frames slower than 1.5 times the target
+};
+
+static bool ConvertFile(const char* Path)
+{
+	FILE* f = fopen(Path, "rb");
+	if (!f) { fprintf(stderr, "Could not open %s\n", Path); return false; }
+	unsigned int Header[2];
+	if (fread(Header, sizeof(Header), 1, f) != 1 || Header[0] != TELEMETRY_MAGIC || Header[1] != TELEMETRY_VERSION)
+	{
+		fprintf(stderr, "%s is not a telemetry log\n", Path);
+		fclose(f);
+		return false;
+	}
+	std::vector<unsigned char> Data;
+	std::vector<sTelemetryRecord> Records;
+	for (unsigned int Chunk[2]; fread(Chunk, sizeof(Chunk), 1, f) == 1;)
+	{
+		Data.resize(Chunk[1]);
+		if ((Chunk[1] && fread(&Data[0], Chunk[1], 1, f) != 1) || !TelemetryDecompress(Data.data(), Data.size(), (int)Chunk[0], Records))
+		{
+			fprintf(stderr, "%s is truncated or corrupt\n", Path);
+			break; //keep what was read so far, the game may have been killed while writing
+		}
+		for (const sTelemetryRecord& r : Records)
+		{
+			printf("%s,%u,%d,%d,%g,%g,%g,%g,%g\n", (r.Type < TELEMETRY_TYPES ? TelemetryTypeNames[r.Type] : "unknown"),
+				r.Step, r.Mode, r.Planet, r.Power, r.Value[0], r.Value[1], r.Value[2], r.Value[3]);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) { fprintf(stderr, "Usage: %s telemetry files...\n", argv[0]); return 1; }
+	printf("type,step,mode,planet,power,v0,v1,v2,v3\n");
+	bool Ok = true;
+	for (int i = 1; i < argc; i++) Ok &= ConvertFile(argv[i]);
+	return (Ok ? 0 : 1);
+}
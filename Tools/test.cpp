@@ -0,0 +1,357 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Tests for the renderer-free game code, built and run with "make test".
+// Every test function checks results with TEST_CHECK, a failed check prints its
+// location and makes the test run exit with an error.
+
+#include "../simulation.h"
+#include "../replay.h"
+#include "../route.h"
+#include "../snapshot.h"
+#include "../quality.h"
+#include "../telemetry.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+static int Checks, Failures;
+
+#define TEST_CHECK(Cond) ((Checks++, (Cond)) ? (void)0 : (Failures++, (void)printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #Cond)))
+
+static bool Near(float a, float b, float Epsilon = 1.e-3f) { return fabsf(a - b) <= Epsilon; }
+
+static void TestSimulationStepping()
+{
+	sSimulation Sim, Other;
+	Sim.Start(1234);
+	Other.Start(1234);
+	TEST_CHECK(Sim.Planets.Size() > 10 && Sim.Planets.Size() == Other.Planets.Size());
+	TEST_CHECK(Sim.Planets.Z == Other.Planets.Z && Sim.Planets.X == Other.Planets.X && Sim.Planets.Radius == Other.Planets.Radius);
+	TEST_CHECK(Sim.Planets.Info.back().IsHome && Sim.Power == PowerStart);
+	for (int i = 1; i < Sim.Planets.Size(); i++) TEST_CHECK(Sim.Planets.Z[i-1] <= Sim.Planets.Z[i]);
+
+	//flying straight drains one power per unit, a full tank runs out at z 100 before reaching the goal at 150
+	TEST_CHECK(Sim.Step(Sim.GetStepMove(SimStepSeconds)) == SIMEVENT_NONE);
+	TEST_CHECK(Near(Sim.Pos.z, 2.f / 60.f, 1.e-6f) && Near(Sim.Power, PowerStart - 2.f / 60.f, 1.e-4f));
+	eSimEvent Event = SIMEVENT_NONE;
+	for (int i = 0; i < 100000 && Event == SIMEVENT_NONE; i++) Event = Sim.Step(Sim.GetStepMove(SimStepSeconds));
+	TEST_CHECK(Event == SIMEVENT_LOSE && Sim.Power == 0 && Near(Sim.Pos.z, 100.f));
+
+	//with a shorter goal the same run is won
+	Other.Params.GoalDistance = 50.f;
+	Other.Start(1234);
+	for (Event = SIMEVENT_NONE; Event == SIMEVENT_NONE;) Event = Other.Step(1.f);
+	TEST_CHECK(Event == SIMEVENT_WIN && Near(Other.Pos.z, 50.f) && Near(Other.Power, PowerStart - 50.f));
+
+	//visiting a planet lands on it and applies its gain and loss clamped to [0, PowerStart]
+	Sim.Start(1234);
+	int First, End, Planet = -1;
+	Sim.VisitableRange(First, End);
+	for (int i = First; i < End && Planet < 0; i++) if (Sim.IsVisitable(i)) Planet = i;
+	TEST_CHECK(Planet >= 0);
+	if (Planet < 0) return;
+	const sSimTravel Travel = Sim.CalcTravel(Planet);
+	Sim.Visit(Planet);
+	TEST_CHECK(Sim.TravelPlanet == Planet && Sim.Distance == Travel.Distance);
+	for (Event = SIMEVENT_NONE; Event == SIMEVENT_NONE;) Event = Sim.Step(Sim.GetStepMove(SimStepSeconds));
+	const sSimPlanetInfo& p = Sim.Planets.Info[Planet];
+	const float Expected = PowerStart - Sim.GetDrainFactor(Travel.Dir) * Travel.Distance + p.GainByPower - p.LoseByEnemy;
+	TEST_CHECK(Event == SIMEVENT_LANDED && Sim.LandedPlanet == Planet && p.Cleared && !Sim.IsVisitable(Planet));
+	TEST_CHECK(Near(Sim.Power, (Expected < 0 ? 0 : (Expected > PowerStart ? PowerStart : Expected)), 1.e-2f));
+	Sim.Continue();
+	TEST_CHECK(Sim.TravelPlanet < 0 && Sim.LandedPlanet < 0 && Sim.LastTravelPlanet == Planet);
+}
+
+static void TestPlanetStoreRange()
+{
+	sPlanetStore Store;
+	const float Z[] = { 1, 2, 2, 3, 5 };
+	sSimPlanetInfo Info;
+	memset(&Info, 0, sizeof(Info));
+	for (int i = 0; i < 5; i++) Store.Add(sSimVec3(0, 0, Z[i]), 1.f, Info);
+	int First, End;
+	Store.Range(2, 3, First, End);     TEST_CHECK(First == 1 && End == 4);
+	Store.Range(0, 10, First, End);    TEST_CHECK(First == 0 && End == 5);
+	Store.Range(2.5f, 2.9f, First, End); TEST_CHECK(First == 3 && End == 3);
+	Store.Range(-2, 0, First, End);    TEST_CHECK(First == 0 && End == 0);
+	Store.Range(6, 7, First, End);     TEST_CHECK(First == 5 && End == 5);
+	Store.Range(5, 5, First, End);     TEST_CHECK(First == 4 && End == 5);
+	Store.EraseFront(2);
+	Store.Range(2, 3, First, End);     TEST_CHECK(Store.Size() == 3 && First == 0 && End == 2);
+}
+
+//Plays a game step by step like the game loop does and records the decisions of a simple policy
+static void RecordGame(sRecording& Rec, unsigned int Seed)
+{
+	sSimulation Sim;
+	Sim.Start(Seed);
+	Rec.Reset(Seed, false);
+	unsigned int Steps = 0;
+	for (eSimEvent Event = SIMEVENT_NONE; Event != SIMEVENT_WIN && Event != SIMEVENT_LOSE && Steps < 100000;)
+	{
+		if (Event == SIMEVENT_LANDED) { Rec.Add(Steps, REPLAY_CONTINUE, Sim.LandedPlanet); Sim.Continue(); }
+		if (Sim.TravelPlanet < 0 && Sim.Power < PowerStart * .8f)
+		{
+			int First, End;
+			Sim.VisitableRange(First, End);
+			for (int i = First; i < End; i++)
+			{
+				if (!Sim.IsVisitable(i) || Sim.Planets.Info[i].ChancePower <= Sim.Planets.Info[i].ChanceEnemy) continue;
+				Rec.Add(Steps, REPLAY_SCAN, i);
+				Rec.Add(Steps, REPLAY_VISIT, i);
+				Sim.Visit(i);
+				break;
+			}
+		}
+		Event = Sim.Step(Sim.GetStepMove(SimStepSeconds));
+		Steps++;
+		if (Event == SIMEVENT_WIN || Event == SIMEVENT_LOSE) Rec.SetResult(Event, Steps, Sim.Power);
+	}
+}
+
+static void TestReplayVerification()
+{
+	sRecording Rec, Loaded;
+	RecordGame(Rec, 77);
+	TEST_CHECK(Rec.Events.size() >= 3 && Rec.ResultEvent != SIMEVENT_NONE);
+
+	sSimulation Sim;
+	eSimEvent Event;
+	unsigned int Steps;
+	TEST_CHECK(VerifyRecording(Sim, Rec, Event, Steps) && Event == Rec.ResultEvent && Steps == Rec.ResultSteps);
+
+	//the text format keeps the exact power so a saved recording verifies as well
+	TEST_CHECK(Rec.Save("test-replay-good.txt") && Loaded.Load("test-replay-good.txt"));
+	TEST_CHECK(Loaded.Events.size() == Rec.Events.size() && VerifyRecording(Sim, Loaded, Event, Steps));
+
+	//a decision made one step later changes the outcome and must be reported as a mismatch
+	sRecording Tampered = Rec;
+	for (size_t i = 0; i < Tampered.Events.size(); i++) Tampered.Events[i].Step++;
+	TEST_CHECK(!VerifyRecording(Sim, Tampered, Event, Steps));
+	TEST_CHECK(Tampered.Save("test-replay-bad.txt"));
+}
+
+//Runs the route planner until it has no plan pending for the current state of Sim
+static void PlanRoute(const sSimulation& Sim)
+{
+	for (int i = 0; i < 1000000; i++)
+	{
+		Route.Update(Sim);
+		if (Route.State.load() == sRouteOptimizer::STATE_IDLE) return;
+		Jobs.Update(4);
+		std::this_thread::yield();
+	}
+}
+
+static void AddRoutePlanet(sSimulation& Sim, float X, float Z, int ChancePower)
+{
+	sSimPlanetInfo Info;
+	memset(&Info, 0, sizeof(Info));
+	Info.ChancePower = ChancePower;
+	Sim.Planets.Add(sSimVec3(X, 0, Z), 1.f, Info);
+}
+
+static void TestRoutePlanner()
+{
+	Jobs.Init();
+	int Visits[4];
+
+	//a planet 8 to the side costs 25.9 extra drain when leaving 35 before it (the cheapest departure) and gains 54.5,
+	//starting at z 0 the departure at z 5 is reached with 55 power but not with 25 which is too little for the trip
+	sSimulation Sim;
+	AddRoutePlanet(Sim, 8, 40, 100);
+	Sim.Pos = sSimVec3(0, 0, 0);
+	Sim.TravelPlanet = -1;
+	Route.Reset();
+	PlanRoute(Sim);
+	TEST_CHECK(Route.HasPlan());
+	Sim.Power = 60; TEST_CHECK(Route.GetNextVisits(Sim, Visits, 4) == 1 && Visits[0] == 0);
+	Sim.Power = 30; TEST_CHECK(Route.GetNextVisits(Sim, Visits, 4) == 0);
+
+	//two overlapping planets on the center line, with 50 power A (z 34) is better, with a full tank its gain is clamped
+	//to the 5.2 missing below PowerStart and B (z 38, 4 less drain, gains 10.2) is better, the same plan answers both
+	sSimulation Galaxy;
+	AddRoutePlanet(Galaxy, 0, 34, 100);
+	AddRoutePlanet(Galaxy, 0, 38, 50);
+	Galaxy.Pos = sSimVec3(0, 0, 31);
+	Galaxy.TravelPlanet = -1;
+	Route.Reset();
+	PlanRoute(Galaxy);
+	Galaxy.Power = 50;  TEST_CHECK(Route.GetNextVisits(Galaxy, Visits, 4) == 1 && Visits[0] == 0);
+	Galaxy.Power = 100; TEST_CHECK(Route.GetNextVisits(Galaxy, Visits, 4) == 1 && Visits[0] == 1);
+
+	//traveling to A replans without it
+	Galaxy.Power = 50;
+	Galaxy.TravelPlanet = 0;
+	PlanRoute(Galaxy);
+	TEST_CHECK(Route.GetNextVisits(Galaxy, Visits, 4) == 1 && Visits[0] == 1);
+
+	Jobs.Shutdown();
+}
+
+static void WriteTestFile(const char* Path, const void* Data, size_t Size)
+{
+	FILE* f = fopen(Path, "wb");
+	if (!f) return;
+	if (Size) fwrite(Data, 1, Size, f);
+	fclose(f);
+}
+
+static void TestSnapshotRoundTrip()
+{
+	//values are stored little endian regardless of the platform
+	sSnapshotWriter Bytes;
+	Bytes.Put(0x04030201u); Bytes.Put(true); Bytes.Put(1.f);
+	const unsigned char Expected[] = { 1, 2, 3, 4, 1, 0x00, 0x00, 0x80, 0x3F };
+	TEST_CHECK(Bytes.Data.size() == sizeof(Expected) && !memcmp(&Bytes.Data[0], Expected, sizeof(Expected)));
+
+	//an endless run in progress with a landed planet and a rebased origin
+	sSimulation Sim;
+	Sim.Start(4321, true);
+	for (int i = 0; i < 200000 && Sim.Origin == 0; i++) { Sim.Power = PowerStart; Sim.Step(1.f); Sim.StreamChunks(); }
+	int First, End, Planet = -1;
+	Sim.VisitableRange(First, End);
+	for (int i = First; i < End && Planet < 0; i++) if (Sim.IsVisitable(i)) Planet = i;
+	TEST_CHECK(Sim.Origin != 0 && Planet >= 0);
+	if (Planet < 0) return;
+	Sim.Visit(Planet);
+	for (eSimEvent Event = SIMEVENT_NONE; Event == SIMEVENT_NONE;) { Sim.Power = PowerStart; Event = Sim.Step(.5f); }
+
+	sSnapshotWriter w;
+	WriteSimulation(w, Sim);
+	sSnapshotReader r(&w.Data[0], w.Data.size());
+	sSimulation Loaded;
+	TEST_CHECK(ReadSimulation(r, Loaded) && r.Cur == r.End);
+	TEST_CHECK(Loaded.Planets.Z == Sim.Planets.Z && Loaded.Planets.X == Sim.Planets.X && Loaded.Planets.Y == Sim.Planets.Y && Loaded.Planets.Radius == Sim.Planets.Radius);
+	TEST_CHECK(Loaded.Planets.Size() == Sim.Planets.Size() && Loaded.Planets.Info[Planet].Cleared && Loaded.Planets.Info[Planet].GainByPower == Sim.Planets.Info[Planet].GainByPower);
+	TEST_CHECK(Loaded.Pos.z == Sim.Pos.z && Loaded.Dir.y == Sim.Dir.y && Loaded.Distance == Sim.Distance && Loaded.Power == Sim.Power);
+	TEST_CHECK(Loaded.TravelPlanet == Sim.TravelPlanet && Loaded.LandedPlanet == Planet && Loaded.LastTravelPlanet == Sim.LastTravelPlanet);
+	TEST_CHECK(Loaded.Endless && Loaded.Seed == 4321 && Loaded.Origin == Sim.Origin && Loaded.ChunkFirst == Sim.ChunkFirst && Loaded.ChunkNext == Sim.ChunkNext);
+	TEST_CHECK(Loaded.ChunkPlanetCounts == Sim.ChunkPlanetCounts && Loaded.Params.TravelDrainFactor == Sim.Params.TravelDrainFactor);
+
+	//both continue the same way
+	Sim.Continue(); Loaded.Continue();
+	for (int i = 0; i < 600; i++) { Sim.Step(Sim.GetStepMove(SimStepSeconds)); Sim.StreamChunks(); Loaded.Step(Loaded.GetStepMove(SimStepSeconds)); Loaded.StreamChunks(); }
+	TEST_CHECK(Loaded.Pos.z == Sim.Pos.z && Loaded.Power == Sim.Power && Loaded.Planets.Size() == Sim.Planets.Size());
+
+	//a cut off snapshot is rejected
+	sSnapshotReader Cut(&w.Data[0], w.Data.size() - 3);
+	TEST_CHECK(!ReadSimulation(Cut, Loaded) && !Cut.Ok);
+
+	//the file writer writes the newest buffer, an empty one clears the file
+	SnapshotFile.Path = "test-snapshot.bin";
+	SnapshotFile.WriteFunc = WriteTestFile;
+	Jobs.Init();
+	std::vector<unsigned char> Old(5, 1), Data = w.Data;
+	SnapshotFile.Write(Old);
+	SnapshotFile.Write(Data);
+	SnapshotFile.Flush();
+	Jobs.Shutdown();
+	FILE* f = fopen("test-snapshot.bin", "rb");
+	std::vector<unsigned char> Read(w.Data.size() + 1);
+	const size_t ReadSize = (f ? fread(&Read[0], 1, Read.size(), f) : 0);
+	if (f) fclose(f);
+	TEST_CHECK(ReadSize == w.Data.size() && !memcmp(&Read[0], &w.Data[0], ReadSize));
+	SnapshotFile.Clear();
+	SnapshotFile.Flush();
+	f = fopen("test-snapshot.bin", "rb");
+	TEST_CHECK(f && fread(&Read[0], 1, 1, f) == 0);
+	if (f) fclose(f);
+}
+
+//Feeds Frames intervals that vsync at RefreshHz would give with every SlowEvery-th frame missing one refresh
+static sQualityGovernor FeedRefresh(float RefreshHz, int SlowEvery, int Frames, const char* Pins = "")
+{
+	sQualityGovernor q;
+	q.LoadPins(Pins);
+	for (int i = 0; i < Frames; i++) q.MeasureRefresh((1000.f / RefreshHz) * (SlowEvery && (i % SlowEvery) == 0 ? 2 : 1) + (i % 3) * .2f);
+	return q;
+}
+
+static void TestQualityRefresh()
+{
+	TEST_CHECK(Near(FeedRefresh(144, 0, 100).TargetMS, 1000.f / 60)); //assumed until the first window is done
+	TEST_CHECK(Near(FeedRefresh(144, 0, 120).TargetMS, 1000.f / 144));
+	TEST_CHECK(Near(FeedRefresh(60, 2, 240).TargetMS, 1000.f / 60)); //every other frame too slow
+	TEST_CHECK(Near(FeedRefresh(75, 5, 120).RefreshMS, 1000.f / 75));
+	TEST_CHECK(Near(FeedRefresh(60, 1, 120).TargetMS, 1000.f / 30)); //GPU bound at half rate from the start
+
+	//a later faster window lowers the target, a slower one does not raise it again
+	sQualityGovernor q = FeedRefresh(120, 0, 120);
+	for (int i = 0; i < 120; i++) q.MeasureRefresh(1000.f / 60);
+	TEST_CHECK(Near(q.TargetMS, 1000.f / 120));
+
+	//a pinned target frame rate is kept
+	sQualityGovernor Pinned = FeedRefresh(144, 0, 240, "target_fps 50\n");
+	TEST_CHECK(Near(Pinned.TargetMS, 1000.f / 50) && Near(Pinned.RefreshMS, 1000.f / 144));
+}
+
+static void TestTelemetryRoundTrip()
+{
+	//runs of identical records give zero runs longer than a run length byte holds
+	std::vector<sTelemetryRecord> Records(700);
+	memset(&Records[0], 0, Records.size() * sizeof(sTelemetryRecord));
+	sSimRand Rand(99);
+	for (size_t i = 0; i < Records.size(); i++)
+	{
+		sTelemetryRecord& r = Records[i];
+		if (i >= 100 && i < 500) { r = Records[99]; continue; }
+		r.Type = (unsigned short)(i % TELEMETRY_TYPES);
+		r.Mode = (unsigned short)(i & 3);
+		r.Step = (unsigned int)i * 60;
+		r.Planet = (i % 7 ? (int)(i / 3) : -1);
+		r.Power = Rand.Range(0, 200);
+		for (int v = 0; v < 4; v++) r.Value[v] = (i % 5 ? Rand.Range(-1, 1) : 0);
+	}
+	std::vector<unsigned char> Compressed;
+	TelemetryCompress(&Records[0], (int)Records.size(), Compressed);
+	TEST_CHECK(!Compressed.empty() && Compressed.size() < Records.size() * sizeof(sTelemetryRecord) / 2);
+	std::vector<sTelemetryRecord> Out;
+	TEST_CHECK(TelemetryDecompress(&Compressed[0], Compressed.size(), (int)Records.size(), Out));
+	TEST_CHECK(Out.size() == Records.size() && !memcmp(&Out[0], &Records[0], Records.size() * sizeof(sTelemetryRecord)));
+
+	//a single record and an empty batch
+	TelemetryCompress(&Records[3], 1, Compressed);
+	TEST_CHECK(TelemetryDecompress(&Compressed[0], Compressed.size(), 1, Out) && !memcmp(&Out[0], &Records[3], sizeof(sTelemetryRecord)));
+	TelemetryCompress(&Records[0], 0, Compressed);
+	TEST_CHECK(Compressed.empty() && TelemetryDecompress(NULL, 0, 0, Out) && Out.empty());
+
+	//cut off data, a wrong record count and a zero run past the end are rejected
+	TelemetryCompress(&Records[0], (int)Records.size(), Compressed);
+	TEST_CHECK(!TelemetryDecompress(&Compressed[0], Compressed.size() - 1, (int)Records.size(), Out));
+	TEST_CHECK(!TelemetryDecompress(&Compressed[0], Compressed.size(), (int)Records.size() + 1, Out));
+	const unsigned char Overrun[] = { 1, 0, 255 };
+	TEST_CHECK(!TelemetryDecompress(Overrun, sizeof(Overrun), 1, Out));
+}
+
+int main()
+{
+	TestSimulationStepping();
+	TestPlanetStoreRange();
+	TestReplayVerification();
+	TestRoutePlanner();
+	TestSnapshotRoundTrip();
+	TestQualityRefresh();
+	TestTelemetryRoundTrip();
+	printf("%d checks, %d failed\n", Checks, Failures);
+	return (Failures ? 1 : 0);
+}
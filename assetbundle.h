@@ -0,0 +1,137 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_ASSETBUNDLE_
+#define _COSMICINFLUX_ASSETBUNDLE_
+
+// Memory mapped asset bundle built from Data by Tools/packassets, with images stored decoded and ship images extruded into meshes.
+// When the bundle file is missing or invalid the assets get loaded from Data as before.
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && !defined(__wasm__) && !defined(__native_client__) && !defined(COSMIC_NO_ASSETMAP)
+#define COSMIC_ASSETMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { ASSETBUNDLE_MAGIC = 0x42414943, ASSETBUNDLE_VERSION = 2, ASSETBUNDLE_NAME = 48, ASSETBUNDLE_ALIGN = 16 };
+enum eAssetType { ASSET_FILE, ASSET_RGBA, ASSET_MESH };
+
+struct sAssetMeshVertex { float Pos[3], Normal[3]; unsigned char Color[4]; }; //layout of ZL_MESH_NORMALS | ZL_MESH_COLORS
+
+struct sAssetBundleHeader { unsigned int Magic, Version, Count, Size; };
+struct sAssetEntry { char Name[ASSETBUNDLE_NAME]; unsigned int Type, Offset, Size, Width, Height; };
+
+static struct sAssetBundle
+{
+	const unsigned char* Data;
+	size_t Size;
+	const sAssetEntry* Entries;
+	unsigned int Count;
+
+	sAssetBundle() : Data(NULL), Size(0), Entries(NULL), Count(0) { }
+	~sAssetBundle() { Close(); }
+
+	//Maps (or reads) the bundle file and checks its index, returns false (and stays empty) if it is missing or invalid
+	bool Open(const char* Path)
+	{
+		Close();
+		#ifdef COSMIC_ASSETMAP
+		int File = open(Path, O_RDONLY);
+		if (File < 0) return false;
+		struct stat FileStat;
+		void* p = (fstat(File, &FileStat) == 0 && FileStat.st_size > 0 ? mmap(NULL, (size_t)FileStat.st_size, PROT_READ, MAP_PRIVATE, File, 0) : MAP_FAILED);
+		close(File); //the mapping stays valid after closing
+		if (p == MAP_FAILED) return false;
+		Size = (size_t)FileStat.st_size;
+		#else
+		FILE* File = fopen(Path, "rb");
+		if (!File) return false;
+		fseek(File, 0, SEEK_END);
+		const long FileSize = ftell(File);
+		fseek(File, 0, SEEK_SET);
+		void* p = (FileSize > 0 ? malloc((size_t)FileSize) : NULL);
+		if (p && fread(p, 1, (size_t)FileSize, File) != (size_t)FileSize) { free(p); p = NULL; }
+		fclose(File);
+		if (!p) return false;
+		Size = (size_t)FileSize;
+		#endif
+		Data = (const unsigned char*)p;
+		if (Validate()) return true;
+		Close();
+		return false;
+	}
+
+	void Close()
+	{
+		#ifdef COSMIC_ASSETMAP
+		if (Data) munmap((void*)Data, Size);
+		#else
+		free((void*)Data);
+		#endif
+		Data = NULL;
+		Size = 0;
+		Entries = NULL;
+		Count = 0;
+	}
+
+	bool Validate()
+	{
+		if (Size < sizeof(sAssetBundleHeader)) return false;
+		const sAssetBundleHeader* h = (const sAssetBundleHeader*)Data;
+		if (h->Magic != ASSETBUNDLE_MAGIC || h->Version != ASSETBUNDLE_VERSION || h->Size != Size) return false;
+		if (h->Count > (Size - sizeof(sAssetBundleHeader)) / sizeof(sAssetEntry)) return false;
+		const sAssetEntry* e = (const sAssetEntry*)(h + 1);
+		for (unsigned int i = 0; i < h->Count; i++)
+		{
+			if (!memchr(e[i].Name, 0, ASSETBUNDLE_NAME) || (i && strcmp(e[i-1].Name, e[i].Name) >= 0)) return false;
+			if (e[i].Offset % ASSETBUNDLE_ALIGN || e[i].Offset > Size || e[i].Size > Size - e[i].Offset) return false;
+			if (e[i].Type == ASSET_RGBA && (!e[i].Width || e[i].Size / e[i].Width / 4 != e[i].Height || e[i].Size % (e[i].Width * 4))) return false;
+			if (e[i].Type == ASSET_MESH && (e[i].Width > 65536 || e[i].Height % 3 || (size_t)e[i].Width * sizeof(sAssetMeshVertex) + (size_t)e[i].Height * 2 != e[i].Size)) return false;
+			if (e[i].Type != ASSET_RGBA && e[i].Type != ASSET_FILE && e[i].Type != ASSET_MESH) return false;
+		}
+		Entries = e;
+		Count = h->Count;
+		return true;
+	}
+
+	//Returns the entry with the path Name of type Type or NULL
+	const sAssetEntry* Find(const char* Name, eAssetType Type) const
+	{
+		unsigned int Lo = 0, Hi = Count;
+		while (Lo < Hi)
+		{
+			const unsigned int Mid = (Lo + Hi) / 2;
+			const int Cmp = strcmp(Entries[Mid].Name, Name);
+			if (!Cmp) return (Entries[Mid].Type == (unsigned int)Type ? &Entries[Mid] : NULL);
+			if (Cmp < 0) Lo = Mid + 1; else Hi = Mid;
+		}
+		return NULL;
+	}
+
+	const unsigned char* GetData(const sAssetEntry* e) const { return Data + e->Offset; }
+} Assets;
+
+#endif //_COSMICINFLUX_ASSETBUNDLE_
@@ -0,0 +1,187 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_BENCHMARK_
+#define _COSMICINFLUX_BENCHMARK_
+
+// Benchmark recorder for the -benchmark scenarios and micro benchmarks, each result is written as one JSON object per line.
+// Only compiled in with COSMIC_BENCHMARK, heap allocations are only counted with COSMIC_BENCHMARK_ALLOCS (it replaces operator new).
+
+#if defined(ZILLALOG) && !defined(COSMIC_BENCHMARK)
+#define COSMIC_BENCHMARK
+#endif
+
+#ifdef COSMIC_BENCHMARK
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+static std::atomic<unsigned long long> BenchAllocCount(0);
+
+#ifdef COSMIC_BENCHMARK_ALLOCS
+static const bool BenchCountsAllocs = true;
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" //false positive when the replaced operators get inlined
+#endif
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define BENCH_NOEXCEPT throw() //Visual Studio 2013 has no noexcept
+#else
+#define BENCH_NOEXCEPT noexcept
+#endif
+void* operator new(size_t Size)
+{
+	BenchAllocCount.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(Size ? Size : 1);
+	if (!p) abort(); //builds without exceptions can't throw bad_alloc
+	return p;
+}
+void* operator new[](size_t Size) { return operator new(Size); }
+void operator delete(void* p) BENCH_NOEXCEPT { free(p); }
+void operator delete[](void* p) BENCH_NOEXCEPT { free(p); }
+void operator delete(void* p, size_t) BENCH_NOEXCEPT { free(p); }
+void operator delete[](void* p, size_t) BENCH_NOEXCEPT { free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+#else
+static const bool BenchCountsAllocs = false;
+#endif
+
+static struct sBenchmark
+{
+	typedef std::chrono::steady_clock Clock;
+
+	FILE* Out;
+	unsigned int Draws;
+
+	//the scenario being recorded
+	const char* Scenario;
+	int Scale, Frame, WarmupFrames;
+	std::vector<float> FrameMS, FrameDraws, FrameAllocs;
+	Clock::time_point FrameStart;
+	unsigned long long FrameAllocStart;
+
+	sBenchmark() : Out(NULL), Draws(0), Scenario(NULL), Scale(0), Frame(0), WarmupFrames(0), FrameAllocStart(0) { }
+	~sBenchmark() { Close(); }
+
+	bool Open(const char* Path, unsigned int Seed)
+	{
+		Out = fopen(Path, "w");
+		if (!Out) return false;
+		fprintf(Out, "{\"type\":\"run\",\"seed\":%u,\"build\":\"%s %s\"}\n", Seed, __DATE__, __TIME__);
+		return true;
+	}
+
+	void Close()
+	{
+		if (Out) fclose(Out);
+		Out = NULL;
+	}
+
+	//Starts recording a scenario, the first WarmupFrames are not part of the results
+	void BeginScenario(const char* Name, int ScenarioScale, int Warmup, int Frames)
+	{
+		Scenario = Name;
+		Scale = ScenarioScale;
+		Frame = 0;
+		WarmupFrames = Warmup;
+		FrameMS.clear(); FrameDraws.clear(); FrameAllocs.clear();
+		FrameMS.reserve(Frames); FrameDraws.reserve(Frames); FrameAllocs.reserve(Frames); //recording must not allocate
+		FrameStart = Clock::now();
+		FrameAllocStart = BenchAllocCount.load(std::memory_order_relaxed);
+		Draws = 0;
+	}
+
+	//Call once per frame at the same spot in the frame, measures the time since the last call
+	void EndFrame()
+	{
+		const Clock::time_point Now = Clock::now();
+		const unsigned long long Allocs = BenchAllocCount.load(std::memory_order_relaxed);
+		if (Frame++ >= WarmupFrames)
+		{
+			FrameMS.push_back(std::chrono::duration<float, std::milli>(Now - FrameStart).count());
+			FrameDraws.push_back((float)Draws);
+			FrameAllocs.push_back((float)(Allocs - FrameAllocStart));
+		}
+		FrameStart = Now;
+		FrameAllocStart = Allocs;
+		Draws = 0;
+	}
+
+	int RecordedFrames() const { return (int)FrameMS.size(); }
+
+	static float Percentile(std::vector<float>& Values, int Percent)
+	{
+		if (Values.empty()) return 0;
+		const size_t n = (Percent < 100 ? Values.size() * Percent / 100 : Values.size() - 1);
+		std::nth_element(Values.begin(), Values.begin() + n, Values.end());
+		return Values[n];
+	}
+
+	static float Mean(const std::vector<float>& Values)
+	{
+		double Sum = 0;
+		for (size_t i = 0; i < Values.size(); i++) Sum += Values[i];
+		return (Values.empty() ? 0.f : (float)(Sum / Values.size()));
+	}
+
+	void EndScenario()
+	{
+		if (!Out || !Scenario) return;
+		const float DrawsMean = Mean(FrameDraws);
+		char Allocs[64] = "\"allocs_mean\":null,\"allocs_max\":null";
+		if (BenchCountsAllocs) sprintf(Allocs, "\"allocs_mean\":%.2f,\"allocs_max\":%.0f", Mean(FrameAllocs), Percentile(FrameAllocs, 100));
+		fprintf(Out, "{\"type\":\"scenario\",\"name\":\"%s\",\"scale\":%d,\"frames\":%d,\"ms_p50\":%.4f,\"ms_p90\":%.4f,\"ms_p99\":%.4f,\"ms_max\":%.4f,"
+			"\"draws_mean\":%.1f,\"draws_max\":%.0f,%s}\n",
+			Scenario, Scale, RecordedFrames(), Percentile(FrameMS, 50), Percentile(FrameMS, 90), Percentile(FrameMS, 99), Percentile(FrameMS, 100),
+			DrawsMean, Percentile(FrameDraws, 100), Allocs);
+		fflush(Out);
+		Scenario = NULL;
+	}
+
+	//Runs Func Iterations times and writes the time and allocations per call
+	void Micro(const char* Name, int MicroScale, int Iterations, void (*Func)())
+	{
+		if (!Out) return;
+		Func(); //warm up caches and lazily grown buffers
+		const unsigned long long AllocStart = BenchAllocCount.load(std::memory_order_relaxed);
+		const Clock::time_point Start = Clock::now();
+		for (int i = 0; i < Iterations; i++) Func();
+		const double NS = std::chrono::duration<double, std::nano>(Clock::now() - Start).count();
+		const unsigned long long Allocs = BenchAllocCount.load(std::memory_order_relaxed) - AllocStart;
+		char AllocsPerOp[32] = "null";
+		if (BenchCountsAllocs) sprintf(AllocsPerOp, "%.2f", (double)Allocs / Iterations);
+		fprintf(Out, "{\"type\":\"micro\",\"name\":\"%s\",\"scale\":%d,\"iterations\":%d,\"ns_per_op\":%.1f,\"allocs_per_op\":%s}\n",
+			Name, MicroScale, Iterations, NS / Iterations, AllocsPerOp);
+		fflush(Out);
+	}
+} Bench;
+
+#define BENCH_DRAWS(Count) (Bench.Draws += (unsigned int)(Count))
+#else
+#define BENCH_DRAWS(Count)
+#endif
+
+#endif //_COSMICINFLUX_BENCHMARK_
@@ -0,0 +1,120 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_JOBS_
+#define _COSMICINFLUX_JOBS_
+
+// Worker thread pool for CPU-only work (no GL calls in jobs), without threads Update() runs the jobs on the main thread with a time budget.
+
+#if !defined(__EMSCRIPTEN__) && !defined(__wasm__) && !defined(__native_client__) && !defined(COSMIC_NO_THREADS)
+#define COSMIC_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+#include <deque>
+#include <vector>
+#include <chrono>
+
+typedef void (*JobFunc)(void* Data, int Index);
+
+static struct sJobSystem
+{
+	struct sJob { JobFunc Func; void* Data; int Index; };
+	std::deque<sJob> Queue;
+
+	#ifdef COSMIC_THREADS
+	std::vector<std::thread> Workers;
+	std::mutex Mutex;
+	std::condition_variable Signal;
+	bool Quit;
+
+	sJobSystem() : Quit(false) { }
+	~sJobSystem() { Shutdown(); }
+
+	void Init()
+	{
+		if (!Workers.empty()) return;
+		unsigned int Count = std::thread::hardware_concurrency();
+		Count = (Count > 2 ? Count - 1 : 1); //leave one core for the main thread
+		for (unsigned int i = 0; i < Count; i++) Workers.push_back(std::thread(WorkerMain, this));
+	}
+
+	void Shutdown()
+	{
+		{ std::lock_guard<std::mutex> Lock(Mutex); Quit = true; Queue.clear(); }
+		Signal.notify_all();
+		for (size_t i = 0; i < Workers.size(); i++) Workers[i].join();
+		Workers.clear();
+		Quit = false;
+	}
+
+	//Queues Func(Data, i) for i in [0, Count)
+	void Add(JobFunc Func, void* Data, int Count = 1)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			for (int i = 0; i < Count; i++) { sJob j = { Func, Data, i }; Queue.push_back(j); }
+		}
+		Signal.notify_all();
+	}
+
+	void Update(int) { }
+
+	static void WorkerMain(sJobSystem* Jobs)
+	{
+		for (;;)
+		{
+			sJob j;
+			{
+				std::unique_lock<std::mutex> Lock(Jobs->Mutex);
+				while (!Jobs->Quit && Jobs->Queue.empty()) Jobs->Signal.wait(Lock);
+				if (Jobs->Quit) return;
+				j = Jobs->Queue.front();
+				Jobs->Queue.pop_front();
+			}
+			j.Func(j.Data, j.Index);
+		}
+	}
+	#else
+	void Init() { }
+	void Shutdown() { Queue.clear(); }
+
+	void Add(JobFunc Func, void* Data, int Count = 1)
+	{
+		for (int i = 0; i < Count; i++) { sJob j = { Func, Data, i }; Queue.push_back(j); }
+	}
+
+	//Runs queued jobs on the calling thread until BudgetMS milliseconds have passed
+	void Update(int BudgetMS)
+	{
+		const std::chrono::steady_clock::time_point End = std::chrono::steady_clock::now() + std::chrono::milliseconds(BudgetMS);
+		while (!Queue.empty() && std::chrono::steady_clock::now() < End)
+		{
+			sJob j = Queue.front();
+			Queue.pop_front();
+			j.Func(j.Data, j.Index);
+		}
+	}
+	#endif
+} Jobs;
+
+#endif //_COSMICINFLUX_JOBS_
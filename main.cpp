@@ -26,27 +26,63 @@
 #include <ZL_Font.h>
 #include <ZL_Input.h>
 #include <ZL_Surface.h>
-#include <ZL_Particles.h>
 #include <ZL_SynthImc.h>
+#include "simulation.h"
+#include "planetbake.h"
+#include "planetbatch.h"
+#include "starfield.h"
+#include "textcache.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "quality.h"
+#include "replay.h"
+#include "music.h"
+#include "particles.h"
+#include "route.h"
+#include "snapshot.h"
+#include "pipeline.h"
+#include "assetbundle.h"
+#include "telemetry.h"
 
 #include <iostream>
 #include <map>
 #include <vector>
 #include <list>
 #include <algorithm>
+#include <chrono>
+#include <string.h>
 using namespace std;
 
 static ZL_Material matShip;
 static ZL_Mesh mshShip, mshPlanet, mshSky, mshSun;
+enum { PLANET_LODS = 4 };
+static ZL_Mesh mshPlanetLods[PLANET_LODS]; //[0] is mshPlanet
+static const int PlanetLodSegments[PLANET_LODS] = { 63, 31, 17, 9 };
+static const float PlanetLodRadius[PLANET_LODS - 1] = { 120.f, 40.f, 12.f }; //projected radius in pixels above which the next finer lod is used
+static sSphereGeometry PlanetSpheres[PLANET_LODS]; //the geometry of mshPlanetLods, also merged into the planet batches
+enum { PLANET_BATCH_LOD = 2 }; //planets on this lod or coarser are drawn in batches with the procedural look instead of one by one
+static vector<sPlanetBatch> PlanetBatches; //the first ones are in use, filled in order by BuildRenderLists
+static ZL_Material matPlanetBaked, matPlanetBatch;
+static ZL_Material matSky, matSkyPlain; //the sky is switched to the plain black one on the lowest sky detail
 static ZL_Camera Camera;
-static ZL_RenderList RenderList;
+static ZL_RenderList RenderList, SkyRenderList; //persistent, entries reference the matrices below and PlanetMaterials[].Mtx
+static ZL_Matrix MtxSuns[2], MtxShip, MtxSky;
+static bool RenderListDirty = true, RenderListHasShip;
+static int RenderListSize, SkyRenderListSize; //entries in the lists, counted as draws by the benchmark
 static ZL_Font fntMain;
-static ZL_Surface srfLudumDare, srfShip;
-static const float PowerStart = 100.f;
-static const float GoalDistance = 150.f;
-static ZL_ParticleEffect prtExplosion;
-static ZL_TextBuffer TextBuffer;
-extern ZL_SynthImcTrack sndSong, sndWin, sndLose;
+static ZL_Surface srfLudumDare, srfShip, srfSky, srfStar;
+enum { SHIP_VARIANTS = 3 }; //Data/ship1.png to shipN.png, all get built at load
+static ZL_Surface srfShips[SHIP_VARIANTS];
+static ZL_Mesh mshShips[SHIP_VARIANTS]; //extruded in the image plane, MtxShipTurn turns them to fly along z
+static ZL_Matrix MtxShipTurn;
+static ZL_Surface srfTimeline, srfShipIcon; //retained HUD parts, rebuilt when marked dirty
+static bool TimelineDirty = true, ShipIconDirty = true;
+static float TimelineBakedZ, TimelineBakedWidth;
+enum { TIMELINE_MARGIN = 64 };
+static sParticleSystem prtExplosion, prtTrail, prtDebris;
+static float TrailSpawnAccumulator;
+static sTextCache TextCache;
+extern sMusicTrack sndSong, sndWin, sndLose;
 extern ZL_Sound sndBlip;
 static enum eGameMode { MODE_INIT, MODE_INTRO, MODE_RUNNING, MODE_SCANNING, MODE_LANDED, MODE_PAUSE, MODE_WIN, MODE_LOSE } Mode;
 static enum eFadeMode { FADE_NONE, FADE_STARTUP, FADE_TOGAME, FADE_BACKTOTITLE, FADE_QUIT } FadeMode;
@@ -54,98 +90,588 @@ static float FadeStart;
 static bool FadeIn;
 static ticks_t EndTicks;
 
-static struct sPlayer
+static sSimulation Sim;
+static bool EndlessMode;
+static sSimRand PlanetVisualRand; //seeded together with Sim so a run looks the same every time
+static unsigned int SimStepCount, ForcedSeed;
+static float SimAccumulator;
+static sSimVec3 SimPrevPos; //player position before the last simulation step, rendering interpolates from it to Sim.Pos
+enum { SIM_STEP_BUDGET = 15 }; //most steps run in one frame, a longer stall slows the game down instead of stalling more
+enum { SNAPSHOT_INTERVAL_STEPS = 120 }; //while flying the snapshot gets updated every 2 seconds
+static bool HasForcedSeed, Replaying, ShowRoute, Benchmarking;
+#ifdef COSMIC_BENCHMARK
+//-benchmark runs these scenarios one after another on a fixed seed and quits, Scale is the galaxy size
+//relative to a normal game, the explosion bursts spawned per frame or the text lines drawn per frame
+enum eBenchKind { BENCH_GALAXY, BENCH_EXPLOSIONS, BENCH_MENUS };
+struct sBenchScenario { const char* Name; eBenchKind Kind; int Scale; };
+static const sBenchScenario BenchScenarios[] =
 {
-	ZL_Vector3 Pos, Dir;
-	float Distance;
-	float Power;
-} Player;
+	{ "galaxy", BENCH_GALAXY, 1 }, { "galaxy", BENCH_GALAXY, 10 }, { "galaxy", BENCH_GALAXY, 100 }, { "galaxy", BENCH_GALAXY, 1000 },
+	{ "explosions", BENCH_EXPLOSIONS, 20 }, { "explosions", BENCH_EXPLOSIONS, 200 },
+	{ "menus", BENCH_MENUS, 40 }, { "menus", BENCH_MENUS, 240 },
+};
+enum { BENCH_SCENARIOS = sizeof(BenchScenarios) / sizeof(BenchScenarios[0]), BENCH_WARMUP_FRAMES = 60, BENCH_FRAMES = 600 };
+static const char* BenchmarkPath;
+static int BenchScenario = -1;
+static sSimRand BenchRand; //reseeded per scenario so the explosion bursts are the same every run
+static sSimulation* MicroGen; //galaxy and seed used by the generation micro benchmark
+static unsigned int MicroGenSeed;
+#endif
+static sRecording Recording;
+static const char *RecordPath, *ReplayPath;
+static size_t ReplayNext;
+static int ShipVariant = -1;
+static const char* SnapshotPath = "CosmicInflux.snapshot";
+static bool SnapshotStored, SnapshotDirty;
+static unsigned int SnapshotStep; //SimStepCount at the last saved snapshot
+static const char* AssetBundlePath = "CosmicInflux.assets"; //built from Data by Tools/packassets, optional
 
+//Render data of the planets in Sim.Planets (same indices), plain values only so it can be worked on by the pipeline thread
 struct sPlanet
 {
 	ZL_Matrix Mtx;
-	ZL_Material Mat;
 	ZL_Color Col;
-	float Radius;
-	int ChancePower, ChanceEnemy;
-	int GainByPower, LoseByEnemy;
-	bool IsHome, Cleared;
+	float RotY, Fade; //Fade is the brightness in the prepared frame
+	sPlanetLook Look;
+	ZL_Vector Screen; //screen position and size from the last CullPlanets
+	float ScreenRadius;
+	bool Visible;
+	int Lod;
+	bool InList, MtxChanged; //render list entry as last sent to the main thread, only changes get sent
+	int ListLod;
+	float ListFade;
+};
+
+//Material and render list entry of a planet, only used by the main thread and brought in line with Planets by SyncPlanetMaterials
+struct sPlanetMaterial
+{
+	ZL_Material Mat;
+	float Fade; //value last sent to the material
+	sPlanetBake* Bake; //texture being rendered by the job system, NULL when done or not baking
+	ZL_Surface srfBaked;
+	ZL_Matrix Mtx; //referenced by RenderList while InList
+	int Lod;
+	bool InList;
+	int Batch, Slot; //PlanetBatches entry drawing the planet or -1
+	sPlanetMaterial() : Fade(1.f), Bake(NULL), Lod(0), InList(false), Batch(-1), Slot(0) { }
 };
 
+//A prepared frame, the pipeline thread fills one while the main thread draws the other
+struct sRenderPacket { ZL_Matrix Mtx; int Planet, Lod; float Fade; bool InList, Moved; }; //change of a planet render list entry
+enum eFrameEventType { FRAMEEVENT_BLIP, FRAMEEVENT_LANDED, FRAMEEVENT_LOSE, FRAMEEVENT_WIN };
+struct sFrameEvent { eFrameEventType Type; ZL_Vector3 Pos; };
+struct sRenderFrame
+{
+	ZL_Vector3 PlayerPos, ShipSway, CamPos, CamDir, SunPos[2];
+	int WindowFirst, WindowEnd; //planets in the z window around the player
+	vector<sRenderPacket> Packets; //only planets that entered or left the list or changed lod, fade or matrix
+	vector<sFrameEvent> Events; //sounds and effects for the main thread, added while this was the back frame
+};
+static sRenderFrame Frames[2];
+static int FrontFrame;
+static bool FrameStale = true; //set when the game state got replaced and the front frame needs to be prepared again
+static ZL_Camera CullCamera; //camera of the frame being prepared, Camera is the one of the frame being drawn
+static float PrepareElapsed, PrepareSeconds; //frame time and clock handed to the preparation
+#ifdef COSMIC_PROFILER
+static float PrepareMS; //time spent in PrepareFrame on the pipeline thread, added to PROFZONE_SIM after Wait()
+#endif
+static bool PrepareFastForward;
+static int ListFirst, ListEnd; //range of planets that might be in the render list, only used by the preparation
+
+//What the HUD shows, copied from the game state before the next preparation starts changing it
+enum { HIGHLIGHT_NONE, HIGHLIGHT_SCAN, HIGHLIGHT_HOVER, HUD_ROUTE_VISITS = 8 };
+struct sHudMarker { float Z, Radius; ZL_Color Col; bool Show; };
+struct sHudRouteVisit { ZL_Vector Screen; float ScreenRadius, Z; bool OnScreen; };
+static struct sHud
+{
+	eGameMode Mode;
+	float Power, TimelineZ;
+	bool Endless;
+	double TraveledDistance;
+	int Highlight;
+	ZL_Vector HighlightScreen;
+	float HighlightRadius;
+	sHudMarker Marked[3];
+	sHudRouteVisit Route[HUD_ROUTE_VISITS];
+	int RouteCount;
+	bool RouteHasPlan, RouteSuggestVisit;
+	sSimPlanetInfo ScanInfo, LandedInfo;
+	sSimTravel ScanTravel;
+	bool ScanIsTravel;
+} Hud;
+
+//Menu buttons get drawn while the next frame is prepared, their clicks are applied at the start of the next frame
+static enum ePendingAction { ACTION_NONE, ACTION_VISIT, ACTION_IGNORE, ACTION_ABORT, ACTION_CONTINUE, ACTION_NEWGAME } PendingAction;
+static float FadeAlpha;
+
 static vector<sPlanet> Planets;
+static vector<sPlanetMaterial> PlanetMaterials;
+static int PlanetMaterialsRemoved; //planets erased from the front of Planets since the last SyncPlanetMaterials
+static vector<ZL_Material> PlanetMaterialPool, PlanetBakedMaterialPool;
+static vector<sPlanetBake*> PlanetBakesOrphaned;
+static bool BakeTextures = true, PrerenderMusic = true;
+static sStarfieldBake* StarfieldBake;
+static sStarLayer StarLayers[2];
+static int StarLayerCount, StarLayersShown; //StarLayersShown is 0 when the sky detail is too low for the parallax layers
+static std::atomic<int> StartupJobsLeft; //sphere geometry and star layers generated by jobs while Load sets up fonts and shaders
 static ZL_Light Suns[2];
 static ZL_Light* SunList[2] = { &Suns[0], &Suns[1] };
-static sPlanet* ScanPlanet;
-static sPlanet* LandedPlanet;
-static sPlanet* TravelPlanet;
-static sPlanet* LastTravelPlanet;
-static ZL_NameID nmFade = "fade";
-static const float TravelDrainFactor = 4.f;
+static ZL_Vector3 SunPos[2]; //the lights get moved to these with the frame being drawn
+static int ScanPlanet = -1;
+static ZL_NameID nmFade = "fade", nmColA = "cola", nmColB = "colb", nmColW = "colw", nmFacS = "facs", nmFacW = "facw", nmFacC = "facc", nmDetail = "detail";
+static const char* QualityPath = "CosmicInflux.quality"; //optional "key value" lines pinning quality settings, see quality.h
+static sQualitySettings QualityApplied; //changed by the main thread only while the pipeline is idle
+static std::chrono::steady_clock::time_point FrameStartTime;
+static float FrameCpuMS; //main thread time spent in the last AfterFrame
+static bool ShowQuality;
+static const char* TelemetryPath = "CosmicInflux.telemetry"; //rotating gameplay logs .0 to .3, convert with Tools/telemetry2csv
+static int TelemetryFrames, TelemetrySlowFrames;
+static float TelemetryFrameSum, TelemetryFrameMax;
+
+static ZL_Vector3 ToVec3(const sSimVec3& v) { return ZL_Vector3(v.x, v.y, v.z); }
+static ZL_Color RandColor(sSimRand& Rand) { const float r = Rand.Float(), g = Rand.Float(), b = Rand.Float(); return ZL_Color(r, g, b); }
+
+static void SetLookColor(float* Out, const ZL_Color& c) { Out[0] = c.r; Out[1] = c.g; Out[2] = c.b; }
+static ZL_Color GetLookColor(const float* c) { return ZL_Color(c[0], c[1], c[2]); }
+
+//Creates the surface straight from the decoded pixels in the asset bundle or loads the image file if it is not in there
+static ZL_Surface LoadSurface(const char* Path)
+{
+	const sAssetEntry* e = Assets.Find(Path, ASSET_RGBA);
+	return (e ? ZL_Surface(Assets.GetData(e), (int)e->Width, (int)e->Height, 4) : ZL_Surface(Path));
+}
+
+//Takes the mesh extruded by Tools/packassets from the bundle, without one the image gets extruded here
+static ZL_Mesh LoadExtrudedMesh(const char* MeshPath, const ZL_String& ImagePath, const ZL_Material& Material)
+{
+	const sAssetEntry* e = Assets.Find(MeshPath, ASSET_MESH);
+	if (!e) return ZL_Mesh::BuildExtrudePixels(.05f, .1f, ImagePath, Material, false, true, .5f, ZL_Matrix::Identity);
+	const unsigned char* Data = Assets.GetData(e);
+	return ZL_Mesh::Make(ZL_MESH_NORMALS | ZL_MESH_COLORS, (const unsigned short*)(Data + e->Width * sizeof(sAssetMeshVertex)), (int)e->Height, Data, (int)e->Width, Material);
+}
+
+//Only touches the material uniforms (or the batch data) if the value actually changed
+static void SetPlanetFade(sPlanetMaterial& m, float Fade)
+{
+	if (m.Fade == Fade) return;
+	m.Fade = Fade;
+	m.Mat.SetUniformFloat(nmFade, Fade);
+	if (m.Batch >= 0) PlanetBatches[m.Batch].SetFade(m.Slot, Fade);
+}
+
+static void PushFrameEvent(eFrameEventType Type, const ZL_Vector3& Pos = ZL_Vector3::Zero)
+{
+	const sFrameEvent e = { Type, Pos };
+	Frames[1 - FrontFrame].Events.push_back(e);
+}
+
+static void UpdatePlanetMatrix(int i)
+{
+	Planets[i].MtxChanged = true;
+	Planets[i].Mtx = ZL_Matrix::MakeTranslateScale(ToVec3(Sim.Planets.GetPos(i)), ZL_Vector3(Sim.Planets.Radius[i])) *  ZL_Matrix::MakeRotateY(Planets[i].RotY) * ZL_Matrix::MakeRotateX(PIHALF);
+}
+
+//Switches to a finer or coarser sphere only after passing the lod radius by 15% so planets don't flicker between two lods
+static int SelectPlanetLod(int Lod, float ScreenRadius)
+{
+	ScreenRadius *= QualityApplied.PlanetDetail;
+	while (Lod > 0 && ScreenRadius > PlanetLodRadius[Lod - 1] * 1.15f) Lod--;
+	while (Lod < PLANET_LODS - 1 && ScreenRadius < PlanetLodRadius[Lod] * .85f) Lod++;
+	return Lod;
+}
+
+//Tests the bounding spheres of planets in [First, End) against the camera view and picks their lod by projected size
+//Also stores their screen positions which get used for picking
+static void CullPlanets(int First, int End, const ZL_Vector3& CamPos, const ZL_Vector3& CamDir)
+{
+	//pixels per world unit at a distance of 1 along the view direction
+	const float PerpLen = ssqrt(CamDir.x*CamDir.x + CamDir.z*CamDir.z);
+	const ZL_Vector3 Perp(-CamDir.z / PerpLen, 0, CamDir.x / PerpLen);
+	const float PixelScale = CullCamera.WorldToScreen(CamPos + CamDir + Perp).GetDistance(CullCamera.WorldToScreen(CamPos + CamDir));
+	for (int i = First; i < End; i++)
+	{
+		sPlanet& p = Planets[i];
+		const ZL_Vector3 Pos = ToVec3(Sim.Planets.GetPos(i)), To = Pos - CamPos;
+		const float Radius = Sim.Planets.Radius[i], Depth = To.x*CamDir.x + To.y*CamDir.y + To.z*CamDir.z;
+		p.Screen = CullCamera.WorldToScreen(Pos);
+		if (Depth < -Radius) { p.Visible = false; continue; }
+		if (Depth < Radius) { p.Visible = true; p.Lod = 0; p.ScreenRadius = ZLHEIGHT; continue; } //crossing the camera plane
+		p.ScreenRadius = Radius * PixelScale / Depth;
+		const float Margin = p.ScreenRadius * 1.1f;
+		p.Visible = (p.Screen.x > -Margin && p.Screen.x < ZLWIDTH + Margin && p.Screen.y > -Margin && p.Screen.y < ZLHEIGHT + Margin);
+		if (p.Visible) p.Lod = SelectPlanetLod(p.Lod, p.ScreenRadius);
+	}
+}
+
+//Picks the rotation and colors of a new planet, these plain values are all that gets stored in a snapshot
+static void GeneratePlanetLook(sPlanet& p, bool IsHome)
+{
+	p.RotY = PlanetVisualRand.Range(PI,PI2);
+	SetLookColor(p.Look.ColC, ZL_Color::White);
+	if (IsHome)
+	{
+		p.Col = ZL_Color::Blue;
+		SetLookColor(p.Look.ColA, ZL_Color::Green);
+		SetLookColor(p.Look.ColB, ZL_Color::Brown);
+		SetLookColor(p.Look.ColW, ZL_Color::Blue);
+		p.Look.FacS = 25.f;
+		p.Look.FacW = 3.f;
+		p.Look.FacC = 5.f;
+	}
+	else
+	{
+		ZL_Color cola = RandColor(PlanetVisualRand), colb = RandColor(PlanetVisualRand);
+		p.Col = (cola + colb) * .5f;
+		SetLookColor(p.Look.ColA, cola);
+		SetLookColor(p.Look.ColB, colb);
+		SetLookColor(p.Look.ColW, RandColor(PlanetVisualRand));
+		p.Look.FacS = PlanetVisualRand.Range(1,50);
+		p.Look.FacW = PlanetVisualRand.Range(1,5);
+		p.Look.FacC = PlanetVisualRand.Range(3,10);
+	}
+	sPlanetBatch::QuantizeLook(p.Look); //the same look in and out of a batch
+}
+
+//Sets up the material instance (reused from the pool) for the look of a planet
+static void CreatePlanetMaterial(sPlanetMaterial& m, const sPlanet& p)
+{
+	if (PlanetMaterialPool.empty()) m.Mat = mshPlanet.GetMaterial().MakeNewMaterialInstance();
+	else { m.Mat = PlanetMaterialPool.back(); PlanetMaterialPool.pop_back(); }
+	m.Fade = 1.f;
+	m.Mat.SetUniformFloat(nmFade, 1.f);
+	m.Mat.SetUniformVec3(nmColA, GetLookColor(p.Look.ColA));
+	m.Mat.SetUniformVec3(nmColB, GetLookColor(p.Look.ColB));
+	m.Mat.SetUniformVec3(nmColW, GetLookColor(p.Look.ColW));
+	m.Mat.SetUniformFloat(nmFacS, p.Look.FacS);
+	m.Mat.SetUniformFloat(nmFacW, p.Look.FacW);
+	m.Mat.SetUniformFloat(nmFacC, p.Look.FacC);
+	m.Mat.SetUniformFloat(nmDetail, (float)QualityApplied.NoiseDetail);
+	m.Bake = (BakeTextures ? new sPlanetBake(p.Look) : NULL); //the procedural material is used until the baked texture is ready
+}
+
+//Creates render data for planets that were added to Sim.Planets, the main thread creates their material once they come into the view window
+static void AddPlanetVisuals()
+{
+	for (int i = (int)Planets.size(); i < Sim.Planets.Size(); i++)
+	{
+		Planets.push_back(sPlanet());
+		sPlanet& p = Planets.back();
+		GeneratePlanetLook(p, Sim.Planets.Info[i].IsHome);
+		p.Fade = 1.f;
+		p.Lod = PLANET_LODS - 1;
+		UpdatePlanetMatrix(i);
+	}
+}
+
+//Erases the render data of the first Count planets, their materials get returned to the pool by the next SyncPlanetMaterials
+static void RemovePlanetVisuals(int Count)
+{
+	Planets.erase(Planets.begin(), Planets.begin() + Count);
+	PlanetMaterialsRemoved += Count;
+	ListFirst = ZL_Math::Max(ListFirst - Count, 0);
+	ListEnd = ZL_Math::Max(ListEnd - Count, 0);
+}
+
+//Main thread: returns the material instances of removed planets to the pool and makes room for added planets
+static void SyncPlanetMaterials()
+{
+	const int Removed = ZL_Math::Min(PlanetMaterialsRemoved, (int)PlanetMaterials.size());
+	for (int i = 0; i < Removed; i++)
+	{
+		sPlanetMaterial& m = PlanetMaterials[i];
+		if (m.Mat) (m.srfBaked ? PlanetBakedMaterialPool : PlanetMaterialPool).push_back(m.Mat);
+		if (m.Bake) PlanetBakesOrphaned.push_back(m.Bake); //jobs might still be writing to it
+	}
+	if (Removed || PlanetMaterials.size() != Planets.size()) RenderListDirty = true; //entries reference the matrices in PlanetMaterials
+	PlanetMaterials.erase(PlanetMaterials.begin(), PlanetMaterials.begin() + Removed);
+	PlanetMaterials.resize(Planets.size());
+	PlanetMaterialsRemoved = 0;
+}
+
+//Main thread: applies the render list entry changes of a prepared frame
+static void ApplyRenderPackets(sRenderFrame& f)
+{
+	for (vector<sRenderPacket>::const_iterator it = f.Packets.begin(); it != f.Packets.end(); ++it)
+	{
+		sPlanetMaterial& m = PlanetMaterials[it->Planet];
+		if (it->InList != m.InList || it->Lod != m.Lod || (it->Moved && it->InList && it->Lod >= PLANET_BATCH_LOD)) RenderListDirty = true; //batches contain transformed spheres
+		m.InList = it->InList;
+		m.Lod = it->Lod;
+		m.Mtx = it->Mtx;
+		if (m.InList) SetPlanetFade(m, it->Fade);
+	}
+	f.Packets.clear();
+}
+
+static void StartupJob(void*, int Index)
+{
+	if (Index < PLANET_LODS) PlanetSpheres[Index].Build(PlanetLodSegments[Index]);
+	else if (Index == PLANET_LODS) StarLayers[0].Generate(1, 300, 25.f, 45.f, 150.f);
+	else StarLayers[1].Generate(2, 150, 12.f, 25.f, 70.f);
+	StartupJobsLeft--;
+}
+
+//Main thread: waits for the startup jobs, without worker threads they run here (they are queued before any other job)
+static void WaitStartupJobs()
+{
+	while (StartupJobsLeft.load())
+	{
+		#ifdef COSMIC_THREADS
+		std::this_thread::yield();
+		#else
+		Jobs.Update(100);
+		#endif
+	}
+}
+
+//Swaps planets and the sky to the baked material once their texture is done (texture upload has to happen on the main thread)
+static void UpdateTextureBakes()
+{
+	Jobs.Update(4);
+	if (StarfieldBake && StarfieldBake->IsDone())
+	{
+		srfSky = ZL_Surface(&StarfieldBake->Pixels[0], STARFIELD_WIDTH, STARFIELD_HEIGHT, 4);
+		delete StarfieldBake;
+		StarfieldBake = NULL;
+		using namespace ZL_MaterialModes;
+		matSky = ZL_Material(MM_DIFFUSEMAP | MR_TEXCOORD | MO_UNLIT).SetDiffuseTexture(srfSky);
+		if (QualityApplied.SkyDetail) { mshSky.SetMaterial(0, matSky); RenderListDirty = true; }
+	}
+	for (vector<sPlanetMaterial>::iterator it = PlanetMaterials.begin(); it != PlanetMaterials.end(); ++it)
+	{
+		if (!it->Bake || !it->Bake->IsDone()) continue;
+		it->srfBaked = ZL_Surface(&it->Bake->Pixels[0], PLANETBAKE_WIDTH, PLANETBAKE_HEIGHT, 4);
+		delete it->Bake;
+		it->Bake = NULL;
+		PlanetMaterialPool.push_back(it->Mat);
+		if (PlanetBakedMaterialPool.empty()) it->Mat = matPlanetBaked.MakeNewMaterialInstance();
+		else { it->Mat = PlanetBakedMaterialPool.back(); PlanetBakedMaterialPool.pop_back(); }
+		it->Mat.SetDiffuseTexture(it->srfBaked);
+		it->Mat.SetUniformFloat(nmFade, it->Fade);
+		it->Mat.SetUniformFloat(nmDetail, (float)QualityApplied.NoiseDetail);
+		if (it->InList) RenderListDirty = true;
+	}
+	for (size_t i = PlanetBakesOrphaned.size(); i--;)
+	{
+		if (!PlanetBakesOrphaned[i]->IsDone()) continue;
+		delete PlanetBakesOrphaned[i];
+		PlanetBakesOrphaned.erase(PlanetBakesOrphaned.begin() + i);
+	}
+}
+
+//Main thread, endless mode: stream galaxy chunks, keep the suns leapfrogging ahead and follow origin rebasing
+//Planet indices in the taken over frame f get shifted along, its coordinates stay from before a rebase
+static void UpdateEndless(sRenderFrame& f)
+{
+	const double OriginBefore = Sim.Origin;
+	const int Removed = Sim.StreamChunks(), CountBefore = (int)Planets.size() - Removed;
+	if (Removed)
+	{
+		Route.OnPlanetsRemoved(Removed);
+		RemovePlanetVisuals(Removed);
+		ScanPlanet = sSimulation::ShiftIndex(ScanPlanet, Removed);
+		f.WindowFirst = ZL_Math::Max(f.WindowFirst - Removed, 0);
+		f.WindowEnd = ZL_Math::Max(f.WindowEnd - Removed, 0);
+		size_t Kept = 0;
+		for (size_t i = 0; i < f.Packets.size(); i++)
+			if (f.Packets[i].Planet >= Removed) { f.Packets[Kept] = f.Packets[i]; f.Packets[Kept++].Planet -= Removed; }
+		f.Packets.resize(Kept);
+	}
+	AddPlanetVisuals();
+	const float Rebase = (float)(Sim.Origin - OriginBefore);
+	if (Removed || Rebase || CountBefore != (int)Planets.size()) TimelineDirty = true;
+	if (Rebase) for (int i = 0; i < (int)Planets.size(); i++) UpdatePlanetMatrix(i);
+	SimPrevPos.z -= Rebase;
+	for (int i = 0; i < 2; i++)
+	{
+		SunPos[i].z -= Rebase;
+		if (SunPos[i].z < Sim.Pos.z - 40.f) SunPos[i].z += 200.f;
+	}
+}
 
 static struct sCosmicInflux : public ZL_Application
 {
-	sCosmicInflux() : ZL_Application(60) { }
+	sCosmicInflux() : ZL_Application(0) { } //no frame limit, the simulation runs at its fixed step and rendering interpolates
+	~sCosmicInflux() { Pipeline.Shutdown(); SnapshotFile.Flush(); Jobs.Shutdown(); Telemetry.Shutdown(); } //running preparation and jobs must not outlive the game state
 
 	virtual void Load(int argc, char *argv[])
 	{
 		if (!ZL_Application::LoadReleaseDesktopDataBundle()) return;
+		Assets.Open(AssetBundlePath);
 		if (!ZL_Display::Init("Cosmic Influx", 1280, 720, ZL_DISPLAY_ALLOWRESIZEHORIZONTAL | ZL_DISPLAY_DEPTHBUFFER)) return;
-		ZL_Display::SetAA(true);
 		ZL_Display3D::Init(2);
 		ZL_Audio::Init();
 		ZL_Input::Init();
+		PROFILE_STARTUP_STAGE("Init");
+
+		ZL_File QualityFile(QualityPath, "rb");
+		if (QualityFile)
+		{
+			std::vector<char> Text(QualityFile.Size() + 1, 0);
+			QualityFile.Read(&Text[0], Text.size() - 1);
+			Quality.LoadPins(&Text[0]);
+		}
+
+		for (int i = 1; i < argc; i++)
+		{
+			if (!strcmp(argv[i], "-nobake")) BakeTextures = false;
+			if (!strcmp(argv[i], "-quality") && i < argc - 1) Quality.Pin(QKEY_TIER, (float)atof(argv[++i]));
+			if (!strcmp(argv[i], "-livemusic")) PrerenderMusic = false;
+			if (!strcmp(argv[i], "-parallax")) StarLayerCount = 2;
+			if (!strcmp(argv[i], "-seed") && i < argc - 1) { HasForcedSeed = true; ForcedSeed = (unsigned int)strtoul(argv[++i], NULL, 0); }
+			if (!strcmp(argv[i], "-record") && i < argc - 1) RecordPath = argv[++i];
+			if (!strcmp(argv[i], "-replay") && i < argc - 1) ReplayPath = argv[++i];
+			#ifdef COSMIC_BENCHMARK
+			if (!strcmp(argv[i], "-benchmark")) BenchmarkPath = (i < argc - 1 && argv[i+1][0] != '-' ? argv[++i] : "benchmark.json");
+			#endif
+		}
+		if (ReplayPath) Replaying = Recording.Load(ReplayPath);
+
+		//CPU work is queued first so the workers run it while the main thread loads the font and compiles the shaders,
+		//only the sphere meshes wait for their geometry (WaitStartupJobs), the sky bake and music finish during the intro
+		Jobs.Init();
+		Pipeline.Init(PrepareBackFrame);
+		SnapshotFile.Path = SnapshotPath;
+		SnapshotFile.WriteFunc = WriteSnapshotFile;
+		StartupJobsLeft = PLANET_LODS + StarLayerCount;
+		Jobs.Add(StartupJob, NULL, StartupJobsLeft);
+		if (BakeTextures) StarfieldBake = new sStarfieldBake();
+		if (PrerenderMusic) { sndSong.StartRender(); sndWin.StartRender(); sndLose.StartRender(); }
+		PROFILE_STARTUP_STAGE("Jobs");
 
 		ZL_Vector3::Forward = ZL_Vector3(0,0,1);
 		ZL_Vector3::Right = ZL_Vector3(1,0,0);
 		ZL_Vector3::Up = ZL_Vector3(0,1,0);
 
-		fntMain = ZL_Font("Data/vipond_chubby.ttf.zip", 120).SetCharSpacing(-10.0f);
-		TextBuffer = ZL_TextBuffer(fntMain);
+		const sAssetEntry* FontFile = Assets.Find("Data/vipond_chubby.ttf", ASSET_FILE);
+		fntMain = (FontFile ? ZL_Font(ZL_File(Assets.GetData(FontFile), FontFile->Size), 120) : ZL_Font("Data/vipond_chubby.ttf.zip", 120)).SetCharSpacing(-10.0f);
+		TextCache.Init(fntMain);
 
-		srfLudumDare = ZL_Surface("Data/ludumdare.png").SetDrawOrigin(ZL_Origin::BottomRight);
+		srfLudumDare = LoadSurface("Data/ludumdare.png").SetDrawOrigin(ZL_Origin::BottomRight);
+		PROFILE_STARTUP_STAGE("Font");
 
 		using namespace ZL_MaterialModes;
 		matShip = ZL_Material(MM_VERTEXCOLOR);
+		MtxShipTurn = ZL_Matrix::MakeRotateY(-PIHALF)*ZL_Matrix::MakeRotateX(PIHALF);
+		for (int i = 0; i < SHIP_VARIANTS; i++)
+		{
+			ZL_String ShipTexture = ZL_String::format("Data/ship%d.png", i + 1);
+			srfShips[i] = LoadSurface(ShipTexture).SetOrigin(ZL_Origin::Center).SetScale(2.f);
+			mshShips[i] = LoadExtrudedMesh(ZL_String::format("Data/ship%d.mesh", i + 1), ShipTexture, matShip);
+		}
+		PROFILE_STARTUP_STAGE("Ships");
 
-		mshPlanet = ZL_Mesh::BuildSphere(1, 63).SetMaterial(0, ZL_Material(MM_DIFFUSEFUNC | MR_TEXCOORD | MM_SPECULARSTATIC,
+		//The procedural noise shaders are also used while baking, planets and the sky keep them until their bake is done
+		ZL_Material matPlanet(MM_DIFFUSEFUNC | MR_TEXCOORD | MM_SPECULARSTATIC,
 			ZL_GLSL_IMPORTSNOISE()
 			"uniform vec3 cola,colb,colw,colc;"
-			"uniform float facs,facw,facc,fade;"
+			"uniform float facs,facw,facc,fade,detail;"
 			"vec4 CalcDiffuse()"
 			"{"
 				"float s = clamp((snoise((" Z3V_TEXCOORD "+facs)*facs)-.5),0.,1.);"
 				"float w = clamp((snoise((" Z3V_TEXCOORD "+facw)*facw)-.5)*3.,0.,1.);"
 				"float c = clamp((snoise((" Z3V_TEXCOORD "+facc)*facc)-.5)*2.,0.,1.);"
-				"float d = snoise((" Z3V_TEXCOORD "+299.)*299.)*.3;"
+				"float d = (detail > 0. ? snoise((" Z3V_TEXCOORD "+299.)*299.)*.3 : 0.);"
 				"return vec4(mix(vec3(0.), mix(mix(mix(mix(cola,colb, s), vec3(0.,0.,0.), d), colw, w), colc, c), fade), 1.);"
 			"}"
-		));
-		mshPlanet.GetMaterial().SetUniformFloat(Z3U_SPECULAR, .4f);
-		mshPlanet.GetMaterial().SetUniformFloat(Z3U_SHININESS, 1.f);
-		mshPlanet.GetMaterial().SetUniformFloat(nmFade, 1.f);
-		mshPlanet.GetMaterial().SetUniformVec3("colc", ZL_Color::White);
+		);
+		matPlanet.SetUniformVec3("colc", ZL_Color::White);
+		matPlanet.SetUniformFloat(Z3U_SPECULAR, .4f);
+		matPlanet.SetUniformFloat(Z3U_SHININESS, 1.f);
+		matPlanet.SetUniformFloat(nmFade, 1.f);
 
-		mshSky = ZL_Mesh::BuildSphere(50, 20, true).SetMaterial(0, ZL_Material(MM_DIFFUSEFUNC | MR_TEXCOORD | MO_UNLIT,
+		//Planet material with the same look pre-rendered into a texture by planetbake.h, only the fine octave is still evaluated here
+		matPlanetBaked = ZL_Material(MM_DIFFUSEFUNC | MM_DIFFUSEMAP | MR_TEXCOORD | MM_SPECULARSTATIC,
+			ZL_GLSL_IMPORTSNOISE()
+			"uniform float fade,detail;"
+			"vec4 CalcDiffuse()"
+			"{"
+				"vec4 t = texture2D(" Z3U_DIFFUSEMAP ", " Z3V_TEXCOORD ");"
+				"float d = (detail > 0. ? snoise((" Z3V_TEXCOORD "+299.)*299.)*.3 : 0.);"
+				"return vec4(t.rgb * (1. - d * t.a) * fade, 1.);"
+			"}"
+		);
+		matPlanetBaked.SetUniformFloat(Z3U_SPECULAR, .4f);
+		matPlanetBaked.SetUniformFloat(Z3U_SHININESS, 1.f);
+		matPlanetBaked.SetUniformFloat(nmFade, 1.f);
+		matPlanetBaked.SetUniformFloat(nmDetail, 1.f);
+
+		//Planet shader for batches (planetbatch.h), the look of each planet comes from a row of the data texture
+		matPlanetBatch = ZL_Material(MM_DIFFUSEFUNC | MM_DIFFUSEMAP | MR_TEXCOORD | MO_PRECISIONTEXCOORD | MM_SPECULARSTATIC,
+			ZL_GLSL_IMPORTSNOISE()
+			"uniform float detail;"
+			"vec4 SlotData(float x, float Row) { return texture2D(" Z3U_DIFFUSEMAP ", vec2(x, Row * .25 + .125)); }"
+			"vec4 CalcDiffuse()"
+			"{"
+				"float slot = floor(" Z3V_TEXCOORD ".x * .5), x = (slot + .5) / " PLANETBATCH_STRINGIZE(PLANETBATCH_SLOTS) ".;"
+				"vec2 uv = vec2(" Z3V_TEXCOORD ".x - slot * 2., " Z3V_TEXCOORD ".y);"
+				"vec4 cola = SlotData(x, 0.), colb = SlotData(x, 1.), colw = SlotData(x, 2.);"
+				"vec3 fac = floor(vec3(colb.a, colw.a, SlotData(x, 3.).r) * 255. + .5) * .25;"
+				"float s = clamp((snoise((uv+fac.x)*fac.x)-.5),0.,1.);"
+				"float w = clamp((snoise((uv+fac.y)*fac.y)-.5)*3.,0.,1.);"
+				"float c = clamp((snoise((uv+fac.z)*fac.z)-.5)*2.,0.,1.);"
+				"float d = (detail > 0. ? snoise((uv+299.)*299.)*.3 : 0.);"
+				"return vec4(mix(mix(mix(mix(cola.rgb,colb.rgb, s), vec3(0.,0.,0.), d), colw.rgb, w), vec3(1.), c) * cola.a, 1.);"
+			"}"
+		);
+		matPlanetBatch.SetUniformFloat(Z3U_SPECULAR, .4f);
+		matPlanetBatch.SetUniformFloat(Z3U_SHININESS, 1.f);
+		matPlanetBatch.SetUniformFloat(nmDetail, 1.f);
+
+		matSkyPlain = ZL_Material(MM_STATICCOLOR | MO_UNLIT).SetUniformVec4(Z3U_COLOR, ZL_Color::Black);
+		matSky = ZL_Material(MM_DIFFUSEFUNC | MR_TEXCOORD | MO_UNLIT,
 			ZL_GLSL_IMPORTSNOISE()
 			"vec4 CalcDiffuse()"
 			"{"
 				"float s = clamp((snoise(" Z3V_TEXCOORD "*250.0)-.95)*15.,0.,1.);"
 				"return vec4(s,s,s,1);"
 			"}"
-		));
+		);
+		mshSky = ZL_Mesh::BuildSphere(50, 20, true).SetMaterial(0, matSky);
+
+		WaitStartupJobs();
+		mshPlanet = PlanetSpheres[0].MakeMesh(matPlanet);
+		mshPlanetLods[0] = mshPlanet;
+		for (int i = 1; i < PLANET_LODS; i++) mshPlanetLods[i] = PlanetSpheres[i].MakeMesh(matPlanet);
+
+		if (StarLayerCount)
+		{
+			unsigned char StarPixels[8*8*4];
+			for (int i = 0; i < 8*8; i++)
+			{
+				const float dx = (i & 7) - 3.5f, dy = (i >> 3) - 3.5f, a = ZL_Math::Clamp01(1.f - (dx*dx + dy*dy) / 12.25f);
+				StarPixels[i*4+0] = StarPixels[i*4+1] = StarPixels[i*4+2] = 255;
+				StarPixels[i*4+3] = (unsigned char)(a * a * 255.f);
+			}
+			srfStar = ZL_Surface(StarPixels, 8, 8, 4).SetOrigin(ZL_Origin::Center);
+		}
 
 		mshSun = ZL_Mesh::BuildSphere(1, 23).SetMaterial(0, ZL_Material(MM_STATICCOLOR | MO_UNLIT).SetUniformVec4(Z3U_COLOR, ZL_Color::Orange));
-		Suns[0].SetPosition(ZLV3(15,0,20)).SetFalloff(80);
-		Suns[1].SetPosition(ZLV3(-15,0,120)).SetFalloff(80);
+		Suns[0].SetFalloff(80);
+		Suns[1].SetFalloff(80);
+		ApplyQuality(Quality.GetSettings(), true);
+		PROFILE_STARTUP_STAGE("MeshesAndShaders");
 
-		prtExplosion = ZL_ParticleEffect(900);
-		prtExplosion.AddParticleImage(ZL_Surface("Data/smoke.png"), 1000);
-		prtExplosion.AddBehavior(new ZL_ParticleBehavior_LinearMove(300, 20));
-		prtExplosion.AddBehavior((new ZL_ParticleBehavior_LinearColor())->AddColorStart(ZL_Color::Red)->AddColorStart(ZL_Color::Orange)->AddColorStart(ZL_Color::Yellow)->AddColorEnd(ZL_Color::Black));
-		prtExplosion.AddBehavior(new ZL_ParticleBehavior_LinearImageProperties(.5f, .0f, 2.5f, .1f));
+		ZL_Surface srfSmoke = LoadSurface("Data/smoke.png");
+		prtExplosion.Init(srfSmoke, 900, 1.f);
+		prtExplosion.SetMove(300, 20).AddStartColor(ZL_Color::Red).AddStartColor(ZL_Color::Orange).AddStartColor(ZL_Color::Yellow).SetEndColor(ZL_Color::Black).SetAlpha(.5f, 0).SetScale(2.5f, .1f);
+		prtTrail.Init(srfSmoke, 1000, .4f);
+		prtTrail.SetMove(40, 20).AddStartColor(ZL_Color::Yellow).AddStartColor(ZL_Color::Orange).SetEndColor(ZL_Color::Red).SetAlpha(.4f, 0).SetScale(.25f, .05f);
+		prtDebris.Init(srfSmoke, 500, .8f);
+		prtDebris.SetMove(120, 60).AddStartColor(ZL_Color::Gray).AddStartColor(ZL_Color::Brown).SetEndColor(ZL_Color::Black).SetAlpha(.6f, 0).SetScale(.6f, .1f);
+		PROFILE_STARTUP_STAGE("Particles");
 
-		Intro();
+		#ifdef COSMIC_BENCHMARK
+		if (BenchmarkPath && !Replaying && !RecordPath)
+		{
+			if (!HasForcedSeed) { HasForcedSeed = true; ForcedSeed = 1; }
+			Benchmarking = Bench.Open(BenchmarkPath, ForcedSeed);
+		}
+		#endif
+		if (!Replaying && !Benchmarking) Telemetry.Init(TelemetryPath);
+		if (Replaying || RecordPath || Benchmarking || !RestoreSnapshot()) Intro();
 		FadeTo(FADE_STARTUP);
+		PROFILE_STARTUP_STAGE("Intro");
 	}
 
 	void FadeTo(eFadeMode NewFadeMode)
@@ -159,267 +685,276 @@ static struct sCosmicInflux : public ZL_Application
 
 	static void Intro()
 	{
-		Start();
+		EndRecording(SIMEVENT_NONE);
+		ClearSnapshot();
+		EndlessMode = false;
+		Start(true);
 		Mode = MODE_INTRO;
 		for (vector<sPlanet>::iterator it = Planets.begin(); it != Planets.end(); ++it)
 		{
-			it->Mat.SetUniformFloat(nmFade, 1.f);
+			it->Fade = 1.f;
 		}
 		sndSong.Play();
-		Player.Pos = ZL_Vector3(0, 0, 90.f);
+		Sim.Pos = SimPrevPos = sSimVec3(0, 0, 90.f);
 	}
 
-	static void Start()
+	static void Start(bool IsIntro = false)
 	{
 		sndSong.Stop();
+		EndRecording(SIMEVENT_NONE);
 
-		if (Mode != MODE_INTRO)
-		{
-			ZL_String ShipTexture = ZL_String::format("Data/ship%d.png", RAND_INT_RANGE(1,3));
-			srfShip = ZL_Surface(ShipTexture).SetOrigin(ZL_Origin::Center).SetScale(2.f);
-			mshShip = ZL_Mesh::BuildExtrudePixels(.05f, .1f, ShipTexture, matShip, false, true, .5f, ZL_Matrix::MakeRotateY(-PIHALF)*ZL_Matrix::MakeRotateX(PIHALF));
-		}
+		//a replay runs on the recorded seed, otherwise a new random one is used unless one was forced with -seed
+		unsigned int Seed = (HasForcedSeed ? ForcedSeed : (unsigned int)RAND_INT_RANGE(0, 0x7FFFFFFF));
+		if (!IsIntro && Replaying) { Seed = Recording.Seed; EndlessMode = Recording.Endless; ReplayNext = 0; }
+		else if (!IsIntro && RecordPath) Recording.Reset(Seed, EndlessMode);
 
-		Player.Pos = ZL_Vector3(0.f);
-		Player.Power = PowerStart;
+		SelectShip(Seed);
 		Mode = MODE_RUNNING;
-		AdvanceToGoal();
-
-		Planets.clear();
-		for (float i = 0; i < GoalDistance - 7.f; i += RAND_RANGE(1,10))
-		{
-			sPlanet p;
-			ZL_Color cola = RAND_COLOR, colb = RAND_COLOR;
-			p.Col = (cola + colb) * .5f;
-			p.ChancePower = RAND_INT_RANGE(0, 10)*10;
-			p.ChanceEnemy = RAND_INT_RANGE(0, 10)*10;
-			p.GainByPower = (p.ChancePower < RAND_INT_RANGE(0,100) ? 0 : RAND_INT_RANGE(10,100));
-			p.LoseByEnemy = (p.ChanceEnemy < RAND_INT_RANGE(0,100) ? 0 : RAND_INT_RANGE(10,100));
-			p.Radius = RAND_RANGE(.25,1.5);
-			p.Mtx = ZL_Matrix::MakeTranslateScale(ZLV3(RAND_RANGE(1,4)*RAND_SIGN, RAND_RANGE(1,4)*RAND_SIGN, i), ZL_Vector3(p.Radius)) *  ZL_Matrix::MakeRotateY(RAND_RANGE(PI,PI2)) * ZL_Matrix::MakeRotateX(PIHALF);
-			p.Mat = mshPlanet.GetMaterial().MakeNewMaterialInstance();
-			p.Mat.SetUniformFloat(nmFade, 1.f);
-			p.Mat.SetUniformVec3("cola", cola);
-			p.Mat.SetUniformVec3("colb", colb);
-			p.Mat.SetUniformVec3("colw", RAND_COLOR);
-			p.Mat.SetUniformFloat("facs", RAND_RANGE(1,50));
-			p.Mat.SetUniformFloat("facw", RAND_RANGE(1,5));
-			p.Mat.SetUniformFloat("facc", RAND_RANGE(3,10));
-			p.IsHome = false;
-			p.Cleared = false;
-			Planets.push_back(p);
-		}
-		sPlanet Home;
-		Home.Col = ZL_Color::Blue;
-		Home.Radius = 1.f;
-		Home.Mtx = ZL_Matrix::MakeTranslateScale(ZLV3(0, -1.f, GoalDistance + 4.f), ZL_Vector3(Home.Radius)) *  ZL_Matrix::MakeRotateY(RAND_RANGE(PI,PI2)) * ZL_Matrix::MakeRotateX(PIHALF);
-		Home.Mat = mshPlanet.GetMaterial().MakeNewMaterialInstance();
-		Home.Mat.SetUniformFloat(nmFade, 1.f);
-		Home.Mat.SetUniformVec3("cola", ZL_Color::Green);
-		Home.Mat.SetUniformVec3("colb", ZL_Color::Brown);
-		Home.Mat.SetUniformVec3("colw", ZL_Color::Blue);
-		Home.Mat.SetUniformFloat("facs", 25.f);
-		Home.Mat.SetUniformFloat("facw", 3.f);
-		Home.Mat.SetUniformFloat("facc", 5.f);
-		Home.IsHome = true;
-		Planets.push_back(Home);
-	}
-
-	static void AdvanceToGoal()
-	{
-		if (ZL_Vector(-Player.Pos.x, -Player.Pos.y).GetLengthSq() > 0.5f && Mode != MODE_RUNNING)
-		{
-			Player.Dir = ZL_Vector3(-Player.Dir.x, -Player.Dir.y, Player.Dir.z);
-			ZL_Vector3 DirDirect = ZL_Vector3(-Player.Pos.x, -Player.Pos.y).Norm();
-			float Dot = Player.Dir | DirDirect;
-			Player.Distance = ZL_Vector(-Player.Pos.x, -Player.Pos.y).GetLength() / (Dot > 0.01f ? Dot : 1.f);
-		}
-		else
+		ScanPlanet = -1;
+		SunPos[0] = ZLV3(15,0,20);
+		SunPos[1] = ZLV3(-15,0,120);
+		RemovePlanetVisuals((int)Planets.size());
+		SimStepCount = 0;
+		SimAccumulator = 0;
+		Sim.Start(Seed, EndlessMode);
+		Route.Reset();
+		SimPrevPos = Sim.Pos;
+		PlanetVisualRand.SetSeed(Seed ^ 0x2545F491u);
+		AddPlanetVisuals();
+		TimelineDirty = true;
+		FrameStale = true;
+		if (!IsIntro) SnapshotDirty = true;
+		if (!IsIntro) Telemetry.Push(TELEMETRY_RUN, Mode, 0, (int)Seed, Sim.Power, (float)Sim.Endless, (float)Sim.Planets.Size(), (float)ShipVariant);
+	}
+
+	static void SelectShip(unsigned int Seed)
+	{
+		const int Ship = (int)(Seed % SHIP_VARIANTS); //the ship is part of the seeded run
+		if (Ship == ShipVariant) return;
+		ShipVariant = Ship;
+		srfShip = srfShips[Ship];
+		mshShip = mshShips[Ship];
+		ShipIconDirty = RenderListDirty = true;
+	}
+
+	//Returns the visitable planet closest to Pointer on screen, preferring planets about 25 units ahead, or -1
+	static int FindHighlightPlanet(const sRenderFrame& f, const ZL_Vector& Pointer)
+	{
+		int Closest = -1;
+		float ClosestDistSq = S_MAX;
+		for (int i = f.WindowFirst; i < f.WindowEnd; i++)
 		{
-			Player.Pos = ZL_Vector3(0, 0, Player.Pos.z);
-			Player.Dir = ZL_Vector3::Forward;
-			Player.Distance = GoalDistance - Player.Pos.z;
+			const float itZDist = Sim.Planets.Z[i] - f.PlayerPos.z;
+			if (i != Sim.TravelPlanet && (itZDist < 3.f || itZDist > 35.f || Sim.Planets.Info[i].IsHome || Sim.Planets.Info[i].Cleared)) continue;
+			const float distZ = 25.f - itZDist;
+			const float DistSq = Planets[i].Screen.GetDistanceSq(Pointer) + (distZ*distZ*3);
+			if (DistSq > ClosestDistSq) continue;
+			Closest = i;
+			ClosestDistSq = DistSq;
 		}
+		return Closest;
 	}
 
 	virtual void AfterFrame()
 	{
-		if (ZL_Input::Up(ZLK_ESCAPE)) FadeTo(Mode == MODE_INTRO ?  FADE_QUIT : FADE_BACKTOTITLE);
+		const std::chrono::steady_clock::time_point FrameNow = std::chrono::steady_clock::now();
+		const float FrameMS = std::chrono::duration<float, std::milli>(FrameNow - FrameStartTime).count();
+		FrameStartTime = FrameNow;
+		Pipeline.Wait(); //the front frame got prepared while the last frame was drawn, waiting for it is not part of any zone
+		PROFILE_PHASE(PROFZONE_SIM);
+		#ifdef COSMIC_PROFILER
+		PROFILE_ADD(PROFZONE_SIM, PrepareMS); //the preparation work on the pipeline thread
+		PrepareMS = 0;
+		#endif
+		FrontFrame = 1 - FrontFrame;
+		if (Sim.Endless) UpdateEndless(Frames[FrontFrame]);
+		SyncPlanetMaterials();
+		ApplyFrame(Frames[FrontFrame]);
+		PROFILE_PHASE(PROFZONE_BAKES);
+		UpdateTextureBakes();
+		sndSong.Update(); sndWin.Update(); sndLose.Update();
+		PROFILE_PHASE(PROFZONE_SIM);
+		ProcessFrameEvents(Frames[FrontFrame]);
+		ApplyReplayEvents();
+		#ifdef COSMIC_BENCHMARK
+		if (Benchmarking) BenchmarkFrame();
+		#endif
+		if (!Benchmarking && Quality.Update(FrameMS, FrameCpuMS, ZLELAPSED)) ApplyQuality(Quality.GetSettings(), false);
+		UpdateTelemetry(FrameMS);
+		if (ZL_Input::Down(ZLK_F4)) ShowQuality = !ShowQuality;
 
-		if (Mode == MODE_RUNNING)
+		//until the next preparation gets kicked off below the game state belongs to the main thread
+		if (ZL_Input::Up(ZLK_ESCAPE)) FadeTo(Mode == MODE_INTRO ?  FADE_QUIT : FADE_BACKTOTITLE);
+		if (ZL_Input::Down(ZLK_R)) ShowRoute = !ShowRoute;
+		if (ShowRoute && Mode != MODE_INTRO) Route.Update(Sim);
+		ApplyPendingAction();
+		UpdateFade();
+		if (FrameStale)
 		{
-			float Elapsed = ZLELAPSEDF(2);
-			if (TravelPlanet) Elapsed *= 2;
-			#if defined(ZILLALOG)
-			if (ZL_Display::KeyDown[ZLK_LCTRL]) Elapsed *= 50.f;
+			//a new galaxy started, its first frame gets prepared right away
+			PrepareElapsed = 0;
+			PrepareSeconds = ZLSECONDS;
+			PrepareFrame(Frames[FrontFrame]);
+			#ifdef COSMIC_PROFILER
+			PrepareMS = 0; //already part of the running zone
 			#endif
-			float DrainFactor = ZL_Vector3(Player.Dir.x * TravelDrainFactor, Player.Dir.y * TravelDrainFactor, Player.Dir.z).GetLength();
-			float MoveDistance = ZL_Math::Min(ZL_Math::Min(Elapsed, Player.Power / DrainFactor), Player.Distance);
-			Player.Pos += Player.Dir * MoveDistance;
-			Player.Distance -= MoveDistance;
-			Player.Power -= MoveDistance * DrainFactor;
-			if (Player.Distance <= SMALL_NUMBER) Player.Distance = 0;
-			if (!Player.Distance && TravelPlanet)
-			{
-				sndBlip.Play();
-				Mode = MODE_LANDED;
-				LandedPlanet = TravelPlanet;
-				Player.Power = ZL_Math::Clamp(Player.Power + LandedPlanet->GainByPower - LandedPlanet->LoseByEnemy, 0.f, PowerStart);
-				LandedPlanet->Cleared = true;
-			}
-			if (Player.Power <= SMALL_NUMBER && Mode == MODE_RUNNING)
-			{
-				Mode = MODE_LOSE;
-				EndTicks = ZLTICKS;
-				sndLose.Play();
-				const float SwayAmount = ZL_Math::Clamp01((2.f - (ZL_Math::Abs(Player.Pos.x) + ZL_Math::Abs(Player.Pos.y))) / 2.f);
-				const ZL_Vector3 Sway = ZL_Vector3(ssin(Player.Pos.z*.5f),scos(Player.Pos.z*2.25f)*.3f,0) * SwayAmount;
-				for (int i = 0; i < 300; i+= 10) prtExplosion.Spawn(10, Camera.WorldToScreen(Player.Pos + Sway), i);
-				Player.Power = 0;
-			}
-			else if (!Player.Distance && Mode == MODE_RUNNING)
-			{
-				AdvanceToGoal();
-				if (Player.Distance < .2f)
-				{
-					sndWin.Play();
-					Mode = MODE_WIN;
-					EndTicks = ZLTICKS;
-				}
-			}
+			SyncPlanetMaterials();
+			ApplyFrame(Frames[FrontFrame]);
+			FrameStale = false;
 		}
+		const sRenderFrame& f = Frames[FrontFrame];
 
-		float ShipSwayAmount = ZL_Math::Clamp01((2.f - (ZL_Math::Abs(Player.Pos.x) + ZL_Math::Abs(Player.Pos.y))) / 2.f);
-		ZL_Vector3 ShipSway = ZL_Vector3(ssin(Player.Pos.z*.5f),scos(Player.Pos.z*2.25f)*.3f,0) * ShipSwayAmount;
-		ZL_Vector3 CameraOffset = ZLV3(-1 + Player.Pos.x, 1, -3);
-		if (Mode == MODE_INTRO)
-		{
-			ZL_Vector CameraXZ = ZL_Vector(CameraOffset.x, CameraOffset.z).Rotate(ZLSECONDS*.5f);
-			CameraOffset = ZL_Vector3(CameraXZ.x, CameraOffset.y, CameraXZ.y) * .5f;
-			ShipSway = ZL_Vector3::Zero;
-		}
-		Camera.SetPosition(Player.Pos + CameraOffset);
-		Camera.SetDirection(-CameraOffset.VecNorm());
-
-		sPlanet* HighlightPlanet = NULL;
+		PROFILE_PHASE(PROFZONE_PICKING);
+		int HighlightPlanet = -1;
 		ZL_Vector HighlightPlanetScreen;
 		if (Mode == MODE_INTRO)
 		{
 		}
-		else if (ScanPlanet)
+		else if (ScanPlanet >= 0)
 		{
 			HighlightPlanet = ScanPlanet;
-			HighlightPlanetScreen = Camera.WorldToScreen(ScanPlanet->Mtx.GetTranslate());
+			HighlightPlanetScreen = (ScanPlanet >= f.WindowFirst && ScanPlanet < f.WindowEnd ? Planets[ScanPlanet].Screen : Camera.WorldToScreen(ToVec3(Sim.Planets.GetPos(ScanPlanet))));
 		}
-		else if (!LandedPlanet && Player.Power)
+		else if (Sim.LandedPlanet < 0 && Sim.Power)
 		{
-			float ClosestDistSq = S_MAX;
-			for (vector<sPlanet>::iterator it = Planets.begin(); it != Planets.end(); ++it)
-			{
-				const float itZDist = it->Mtx.GetTranslate().z - Player.Pos.z;
-				if (itZDist < -2.f || itZDist > 60.f) continue;
-				if (itZDist > 30.f) it->Mat.SetUniformFloat(nmFade, ZL_Math::Clamp01(ZL_Math::InverseLerp(45.f, 30.f, itZDist)));
-				else if (&*it != TravelPlanet && &*it != LastTravelPlanet && itZDist <  4.f) it->Mat.SetUniformFloat(nmFade, ZL_Math::Clamp01(ZL_Math::InverseLerp(1.f, 4.f, itZDist)));
-				else it->Mat.SetUniformFloat(nmFade, 1.f);
-				if (&*it != TravelPlanet && (itZDist < 3.f || itZDist > 35.f || it->IsHome || it->Cleared)) continue;
-				bool IsOutsideOfView;
-				const ZL_Vector PlanetOnScreen = Camera.WorldToScreen(it->Mtx.GetTranslate(), &IsOutsideOfView);
-				const float distZ = 25.f - itZDist;
-				const float DistSq = PlanetOnScreen.GetDistanceSq(ZL_Input::Pointer()) + (distZ*distZ*3);
-				if (DistSq > ClosestDistSq) continue;
-				HighlightPlanet = &*it;
-				ClosestDistSq = DistSq;
-				HighlightPlanetScreen = PlanetOnScreen;
-			}
+			HighlightPlanet = FindHighlightPlanet(f, ZL_Input::Pointer());
+			if (HighlightPlanet >= 0) HighlightPlanetScreen = Planets[HighlightPlanet].Screen;
+		}
+		Hud.Highlight = HIGHLIGHT_NONE;
+		if (HighlightPlanet >= 0)
+		{
+			const ZL_Vector3 WorldCameraRight = Camera.GetRightDirection();
+			const float ClosestPlanetRadius = Camera.WorldToScreen(ToVec3(Sim.Planets.GetPos(HighlightPlanet)) + WorldCameraRight * Sim.Planets.Radius[HighlightPlanet]).GetDistance(HighlightPlanetScreen);
+			const ZL_Rectf RecPlanet(HighlightPlanetScreen, ClosestPlanetRadius + 5.f);
+			if (ScanPlanet < 0 && !Replaying && ZL_Input::Clicked(RecPlanet)) ScanAction(HighlightPlanet);
+			if (ScanPlanet >= 0) Hud.Highlight = HIGHLIGHT_SCAN;
+			else if (ZL_Input::Hover(RecPlanet)) Hud.Highlight = HIGHLIGHT_HOVER;
+			else HighlightPlanet = -1;
+			Hud.HighlightScreen = HighlightPlanetScreen;
+			Hud.HighlightRadius = ClosestPlanetRadius + 5.f;
 		}
 
-		RenderList.Reset();
-		for (vector<sPlanet>::iterator it = Planets.begin(); it != Planets.end(); ++it)
+		PROFILE_PHASE(PROFZONE_RENDERLIST);
+		MtxSuns[0] = ZL_Matrix::MakeTranslate(f.SunPos[0]);
+		MtxSuns[1] = ZL_Matrix::MakeTranslate(f.SunPos[1]);
+		MtxShip = ZL_Matrix::MakeTranslate(f.PlayerPos + f.ShipSway) * MtxShipTurn;
+		MtxSky = ZL_Matrix::MakeTranslate(f.PlayerPos);
+		if (RenderListDirty || RenderListHasShip != (Sim.Power != 0)) BuildRenderLists(f);
+		for (vector<sPlanetBatch>::iterator it = PlanetBatches.begin(); it != PlanetBatches.end(); ++it) it->Update();
+		CaptureHud(f, HighlightPlanet);
+		if (SnapshotDirty || (Mode == MODE_RUNNING && SimStepCount - SnapshotStep >= SNAPSHOT_INTERVAL_STEPS)) SaveSnapshot();
+
+		//the next frame gets prepared while this one is drawn, from here on only f, Hud and main thread state is used
+		PrepareElapsed = ZLELAPSED;
+		PrepareSeconds = ZLSECONDS;
+		#if defined(ZILLALOG)
+		PrepareFastForward = ZL_Display::KeyDown[ZLK_LCTRL];
+		#endif
+		Pipeline.Kick();
+
+		PROFILE_PHASE(PROFZONE_DRAW3D);
+		if (StarLayersShown)
 		{
-			const float itZDist = it->Mtx.GetTranslate().z - Player.Pos.z;
-			if (Mode != MODE_INTRO && (itZDist < -2.f || itZDist > 60.f)) continue;
-			mshPlanet.SetMaterial(it->Mat);
-			RenderList.Add(mshPlanet, it->Mtx);
+			//parallax stars are drawn between the sky and the rest of the scene
+			ZL_Display3D::DrawListWithLights(SkyRenderList, Camera, SunList, 2);
+			DrawStarLayers(f.PlayerPos.z);
+			BENCH_DRAWS(SkyRenderListSize + StarLayersShown);
 		}
-		RenderList.Add(mshSun, ZL_Matrix::MakeTranslate(Suns[0].GetPosition()));
-		RenderList.Add(mshSun, ZL_Matrix::MakeTranslate(Suns[1].GetPosition()));
-		if (Player.Power) RenderList.Add(mshShip, ZL_Matrix::MakeTranslate(Player.Pos + ShipSway));
-		RenderList.Add(mshSky, ZL_Matrix::MakeTranslate(Player.Pos));
 		ZL_Display3D::DrawListWithLights(RenderList, Camera, SunList, 2);
+		BENCH_DRAWS(RenderListSize);
 
-		if (Mode == MODE_INTRO)
+		if (Hud.Mode == MODE_INTRO)
 		{
+			PROFILE_PHASE(PROFZONE_MENUS);
 			DrawText(ZLCENTER + ZLV(-100, 250), "COSMIC", 1.f, ZL_Origin::Center);
 			DrawText(ZLCENTER + ZLV(100, 150), "INFLUX", 1.f, ZL_Origin::Center);
 			
 			DrawText(ZLV(ZLHALFW, ZLHALFH-160.f), "CLICK TO START", .3f, ZL_Origin::Center);
+			DrawText(ZLV(ZLHALFW, ZLHALFH-195.f), "or press E for endless mode", .2f, ZL_Origin::Center);
 			DrawText(ZLV(ZLHALFW, ZLHALFH-230.f), "Visit dangerous planets to gather enough power to reach home!", .2f, ZL_Origin::Center);
 			DrawText(ZLV(ZLHALFW, ZLHALFH-270.f), "Press Alt-Enter for fullscreen", .2f, ZL_Origin::Center);
 			DrawText(ZLV(25.f, 17.f), "c 2017 Bernhard Schelling - Nukular Design", .3f, ZL_Origin::TopLeft);
 			srfLudumDare.Draw(ZLFROMW(10), 10);
 
-			if (ZL_Input::Clicked())
+			const bool StartEndless = ZL_Input::Down(ZLK_E);
+			if (!FadeMode && (ZL_Input::Clicked() || StartEndless || Replaying))
 			{
+				EndlessMode = StartEndless;
 				sndBlip.Play();
 				FadeTo(FADE_TOGAME);
 			}
 		}
 		else
 		{
-			if (!Player.Power) prtExplosion.Draw();
-
-			if (HighlightPlanet)
+			PROFILE_PHASE(PROFZONE_PARTICLES);
+			if (Hud.Mode == MODE_RUNNING && Hud.Power)
+			{
+				//engine trail with a steady spawn rate independent of the frame rate
+				TrailSpawnAccumulator += ZLELAPSED * 120.f;
+				const int TrailSpawn = (int)TrailSpawnAccumulator;
+				TrailSpawnAccumulator -= TrailSpawn;
+				prtTrail.Spawn(TrailSpawn, Camera.WorldToScreen(f.PlayerPos + f.ShipSway - ZLV3(0, 0, .15f)));
+			}
+			bool DrawExplosions = !Hud.Power;
+			#ifdef COSMIC_BENCHMARK
+			if (IsBenchmarking(BENCH_EXPLOSIONS))
 			{
-				const ZL_Vector3 WorldCameraRight = Camera.GetRightDirection();
-				const float ClosestPlanetRadius = Camera.WorldToScreen(HighlightPlanet->Mtx.GetTranslate() + WorldCameraRight * HighlightPlanet->Radius).GetDistance(HighlightPlanetScreen);
-				const ZL_Rectf RecPlanet(HighlightPlanetScreen, ClosestPlanetRadius + 5.f);
-				if (!ScanPlanet && ZL_Input::Clicked(RecPlanet))
+				for (int b = 0; b < BenchScenarios[BenchScenario].Scale; b++)
 				{
-					sndBlip.Play();
-					Mode = MODE_SCANNING;
-					ScanPlanet = HighlightPlanet;
+					const ZL_Vector Pos(BenchRand.Range(0, ZLWIDTH), BenchRand.Range(0, ZLHEIGHT));
+					prtExplosion.Spawn(10, Pos, BenchRand.Range(0, PI2));
 				}
-				if (ScanPlanet) ZL_Display::DrawCircle(HighlightPlanetScreen, ClosestPlanetRadius + 5.f, ZL_Color::Green, ZLRGBA(0,1,0,.3));
-				else if (ZL_Input::Hover(RecPlanet)) ZL_Display::DrawCircle(HighlightPlanetScreen, ClosestPlanetRadius + 5.f, ZL_Color::Cyan, ZLRGBA(0,1,1,.4));
-				else HighlightPlanet = NULL;
+				DrawExplosions = true;
 			}
+			#endif
+			prtTrail.Update(ZLELAPSED);
+			prtDebris.Update(ZLELAPSED);
+			prtExplosion.Update(ZLELAPSED);
+			prtTrail.Draw();
+			prtDebris.Draw();
+			if (DrawExplosions) prtExplosion.Draw();
+			BENCH_DRAWS((prtTrail.Count > 0) + (prtDebris.Count > 0) + (DrawExplosions && prtExplosion.Count > 0));
+
+			PROFILE_PHASE(PROFZONE_HUD);
+			if (Hud.Highlight == HIGHLIGHT_SCAN) ZL_Display::DrawCircle(Hud.HighlightScreen, Hud.HighlightRadius, ZL_Color::Green, ZLRGBA(0,1,0,.3));
+			if (Hud.Highlight == HIGHLIGHT_HOVER) ZL_Display::DrawCircle(Hud.HighlightScreen, Hud.HighlightRadius, ZL_Color::Cyan, ZLRGBA(0,1,1,.4));
 
-			const float PowerAmountX = ZL_Math::Lerp(152, ZLFROMW(8), ZL_Math::InverseLerp(0.f, PowerStart, Player.Power));
+			//suggested planets to visit next from the route planner
+			for (int r = 0; r < Hud.RouteCount; r++)
+				if (Hud.Route[r].OnScreen) ZL_Display::DrawCircle(Hud.Route[r].Screen, Hud.Route[r].ScreenRadius + 10.f, ZLRGBA(1, 1, 0, r ? .3f : .8f));
+
+			const float PowerAmountX = ZL_Math::Lerp(152, ZLFROMW(8), ZL_Math::InverseLerp(0.f, PowerStart, Hud.Power));
 			ZL_Display::DrawRect(-10, ZLFROMH(30), ZLFROMW(-10), ZLFROMH(-10), ZLWHITE, ZLBLACK);
 			fntMain.Draw(44, ZLFROMH(23), "POWER:", .2f);
 			ZL_Display::DrawRect(152, ZLFROMH(22), PowerAmountX, ZLFROMH(8), ZL_Color::Cyan, ZL_Color::Blue);
 			ZL_Display::DrawRect(150, ZLFROMH(24), ZLFROMW(6), ZLFROMH(6), ZLWHITE);
-			fntMain.Draw(157, ZLFROMH(21), ZL_String::format("%d", (int)(Player.Power+.5f)), .135f);
+			fntMain.Draw(157, ZLFROMH(21), ZL_String::format("%d", (int)(Hud.Power+.5f)), .135f);
 
-			const float ShipPosTimelineX = ZL_Math::Lerp(150, ZLFROMW(15), ZL_Math::InverseLerp(0.f, GoalDistance, Player.Pos.z));
+			//the endless mode timeline scrolls along with the player
+			const float ShipPosTimelineX = GetTimelineX(f.PlayerPos.z, Hud.TimelineZ);
 			ZL_Display::DrawRect(-10,        -10 , ZLFROMW(-10),          30 , ZLWHITE, ZLBLACK);
-			fntMain.Draw(6, 7, "PROGRESS:", .2f);
 			ZL_Display::DrawLine(150, 15, ZLFROMW(15), 15, ZLWHITE);
-			for (vector<sPlanet>::iterator it = Planets.begin(); it != Planets.end(); ++it)
+			srfTimeline.Draw(GetTimelineX(TimelineBakedZ, Hud.TimelineZ) - TIMELINE_MARGIN, 0);
+			if (Hud.Endless) ZL_Display::FillRect(0, 0, 150, 29, ZLBLACK); //hide planets that scrolled past the start of the timeline
+			fntMain.Draw(6, 7, "PROGRESS:", .2f);
+			const ZL_Color MarkedColors[3] = { ZL_Color::Cyan, ZL_Color::Green, ZL_Color::Yellow };
+			for (int m = 0; m < 3; m++)
+				if (Hud.Marked[m].Show) ZL_Display::FillCircle(GetTimelineX(Hud.Marked[m].Z, Hud.TimelineZ), 15, 3 + 4 * Hud.Marked[m].Radius, MarkedColors[m]);
+			for (int m = 0; m < 3; m++)
+				if (Hud.Marked[m].Show) ZL_Display::DrawCircle(GetTimelineX(Hud.Marked[m].Z, Hud.TimelineZ), 15, 4 * Hud.Marked[m].Radius, ZL_Color::Gray, Hud.Marked[m].Col);
+			for (int r = 0; r < Hud.RouteCount; r++)
 			{
-				const float PlanetTimelineX = ZL_Math::Lerp(150, ZLFROMW(15), ZL_Math::InverseLerp(0.f, GoalDistance, it->Mtx.GetTranslate().z));
-				if (&*it == HighlightPlanet) ZL_Display::FillCircle(PlanetTimelineX, 15, 3 + 4 * it->Radius, ZL_Color::Cyan);
-				if (&*it == ScanPlanet)      ZL_Display::FillCircle(PlanetTimelineX, 15, 3 + 4 * it->Radius, ZL_Color::Green);
-				if (&*it == TravelPlanet)    ZL_Display::FillCircle(PlanetTimelineX, 15, 3 + 4 * it->Radius, ZL_Color::Yellow);
-				ZL_Display::DrawCircle(PlanetTimelineX, 15, 4 * it->Radius, ZL_Color::Gray, it->Col);
+				const float z = Hud.Route[r].Z;
+				if (z >= Hud.TimelineZ && z <= Hud.TimelineZ + GoalDistance) ZL_Display::FillCircle(GetTimelineX(z, Hud.TimelineZ), 26, 2.5f, ZL_Color::Yellow);
 			}
 			ZL_Display::DrawLine(150, 5, 150, 25, ZLWHITE);
-			ZL_Display::DrawCircle(ZLFROMW(15), 15, 10, ZL_Color::White, ZL_Color::Black);
-			ZL_Display::DrawCircle(ZLFROMW(15), 15, 7, ZL_Color::White, ZL_Color::Black);
-			ZL_Display::DrawCircle(ZLFROMW(15), 15, 4, ZL_Color::White, ZL_Color::Black);
 			ZL_Display::FillCircle(ShipPosTimelineX, 15, 15, ZLLUMA(.3,.6));
-			for (int i = 0; i < 5; i++) srfShip.Draw(ShipPosTimelineX, 15);
+			srfShipIcon.Draw(ShipPosTimelineX, 15);
 
-			if (Mode == MODE_SCANNING)
+			PROFILE_PHASE(PROFZONE_MENUS);
+			if (Hud.Mode == MODE_SCANNING)
 			{
 				const ZL_Rectf RecMenu(ZLCENTER, ZLV(300, 150));
-				const ZL_Vector3 TravelTarget = ScanPlanet->Mtx.GetTranslate() + ZLV3(0, ssign(ScanPlanet->Mtx.GetTranslate().y) * -ScanPlanet->Radius, -ScanPlanet->Radius - .2f);
-				const ZL_Vector3 TravelDelta = (TravelTarget - Player.Pos);
-				const float TravelDistance = TravelDelta.GetLength();
-				const ZL_Vector3 TravelDir = TravelDelta / TravelDistance;
-				const float TravelDeltaDrain = ZL_Vector3(TravelDir.x * TravelDrainFactor, TravelDir.y * TravelDrainFactor, TravelDir.z).GetLength();
-				const float TravelDrainTotal = TravelDeltaDrain * TravelDistance * 2.f;
-				const float TravelDrainExtra = TravelDrainTotal - ((TravelTarget.z - Player.Pos.z) * 2.f);
 				ZL_Display::DrawRect(RecMenu, ZLWHITE, ZLLUMA(1, .5));
 				DrawText(RecMenu.HighLeft() + ZLV(300,  -35), "Planet Scan", .25f, ZL_Origin::BottomCenter);
 				ZL_Display::DrawLine(RecMenu.HighLeft() + ZLV(20, -50), RecMenu.HighRight() + ZLV(-20, -50), ZLWHITE);
@@ -427,35 +962,21 @@ static struct sCosmicInflux : public ZL_Application
 				DrawText(RecMenu.HighLeft() + ZLV(30, -110), "Chance of Enemy:", .25f);
 				DrawText(RecMenu.HighLeft() + ZLV(30, -160), "Distance:", .25f);
 				DrawText(RecMenu.HighLeft() + ZLV(30, -200), "Required Extra Travel Power:", .25f);
-				DrawText(RecMenu.HighRight() + ZLV(-30,  -80), ZL_String::format("%d", ScanPlanet->ChancePower), .25f, ZL_Origin::BottomRight);
-				DrawText(RecMenu.HighRight() + ZLV(-30, -110), ZL_String::format("%d", ScanPlanet->ChanceEnemy), .25f, ZL_Origin::BottomRight);
-				DrawText(RecMenu.HighRight() + ZLV(-30, -160), ZL_String::format("%d", (int)(TravelDistance + .5f)), .25f, ZL_Origin::BottomRight);
-				DrawText(RecMenu.HighRight() + ZLV(-30, -200), ZL_String::format("%d", (int)(TravelDrainExtra - .5f)), .25f, ZL_Origin::BottomRight);
-				if (Button(ZL_Rectf(RecMenu.LowLeft() +  ZLV(150, 50), ZLV(100, 30)), "VISIT"))
+				DrawText(RecMenu.HighRight() + ZLV(-30,  -80), ZL_String::format("%d", Hud.ScanInfo.ChancePower), .25f, ZL_Origin::BottomRight);
+				DrawText(RecMenu.HighRight() + ZLV(-30, -110), ZL_String::format("%d", Hud.ScanInfo.ChanceEnemy), .25f, ZL_Origin::BottomRight);
+				if (ShowRoute && Hud.RouteHasPlan)
 				{
-					sndBlip.Play();
-					TravelPlanet = ScanPlanet;
-					Player.Distance = TravelDistance;
-					Player.Dir = TravelDir;
-					ScanPlanet = NULL;
-					Mode = MODE_RUNNING;
-				}
-				else if (Button(ZL_Rectf(RecMenu.LowRight() +  ZLV(-150, 50), ZLV(100, 30)), (ScanPlanet == TravelPlanet ? "ABORT" : "IGNORE")))
-				{
-					sndBlip.Play();
-					if (ScanPlanet == TravelPlanet) { LastTravelPlanet = TravelPlanet; TravelPlanet = NULL; AdvanceToGoal(); }
-					ScanPlanet = NULL;
-					Mode = MODE_RUNNING;
-				}
-				else if (ZL_Input::ClickedOutside(RecMenu))
-				{
-					sndBlip.Play();
-					ScanPlanet = NULL;
-					Mode = MODE_RUNNING;
+					DrawText(RecMenu.HighLeft() + ZLV(30, -135), "Route Suggestion:", .2f);
+					DrawText(RecMenu.HighRight() + ZLV(-30, -135), (Hud.RouteSuggestVisit ? "VISIT" : "SKIP"), .2f, ZL_Origin::BottomRight);
 				}
+				DrawText(RecMenu.HighRight() + ZLV(-30, -160), ZL_String::format("%d", (int)(Hud.ScanTravel.Distance + .5f)), .25f, ZL_Origin::BottomRight);
+				DrawText(RecMenu.HighRight() + ZLV(-30, -200), ZL_String::format("%d", (int)(Hud.ScanTravel.DrainExtra - .5f)), .25f, ZL_Origin::BottomRight);
+				if (Button(ZL_Rectf(RecMenu.LowLeft() +  ZLV(150, 50), ZLV(100, 30)), "VISIT")) PendingAction = ACTION_VISIT;
+				else if (Button(ZL_Rectf(RecMenu.LowRight() +  ZLV(-150, 50), ZLV(100, 30)), (Hud.ScanIsTravel ? "ABORT" : "IGNORE"))) PendingAction = (Hud.ScanIsTravel ? ACTION_ABORT : ACTION_IGNORE);
+				else if (ZL_Input::ClickedOutside(RecMenu)) PendingAction = ACTION_IGNORE;
 			}
 
-			if (Mode == MODE_LANDED)
+			if (Hud.Mode == MODE_LANDED)
 			{
 				const ZL_Rectf RecMenu(ZLCENTER, ZLV(300, 150));
 				ZL_Display::DrawRect(RecMenu, ZLWHITE, ZLLUMA(1, .5));
@@ -463,73 +984,674 @@ static struct sCosmicInflux : public ZL_Application
 				ZL_Display::DrawLine(RecMenu.HighLeft() + ZLV(20, -50), RecMenu.HighRight() + ZLV(-20, -50), ZLWHITE);
 				DrawText(RecMenu.HighLeft() + ZLV(30,  -80), "Found Power Supply:", .25f);
 				DrawText(RecMenu.HighLeft() + ZLV(30, -110), "Power Lost in Battle:", .25f);
-				DrawText(RecMenu.HighRight() + ZLV(-30,  -80), ZL_String::format("%d", LandedPlanet->GainByPower), .25f, ZL_Origin::BottomRight);
-				DrawText(RecMenu.HighRight() + ZLV(-30, -110), ZL_String::format("%d", LandedPlanet->LoseByEnemy), .25f, ZL_Origin::BottomRight);
-				if (Button(ZL_Rectf(RecMenu.LowLeft() +  ZLV(300, 50), ZLV(250, 30)), (Player.Power ? "CONTINUE" : "OOPS")) || ZL_Input::ClickedOutside(RecMenu))
-				{
-					sndBlip.Play();
-					AdvanceToGoal();
-					LastTravelPlanet = TravelPlanet; 
-					TravelPlanet = NULL;
-					LandedPlanet = NULL;
-					Mode = MODE_RUNNING;
-				}
+				DrawText(RecMenu.HighRight() + ZLV(-30,  -80), ZL_String::format("%d", Hud.LandedInfo.GainByPower), .25f, ZL_Origin::BottomRight);
+				DrawText(RecMenu.HighRight() + ZLV(-30, -110), ZL_String::format("%d", Hud.LandedInfo.LoseByEnemy), .25f, ZL_Origin::BottomRight);
+				if (Button(ZL_Rectf(RecMenu.LowLeft() +  ZLV(300, 50), ZLV(250, 30)), (Hud.Power ? "CONTINUE" : "OOPS")) || ZL_Input::ClickedOutside(RecMenu)) PendingAction = ACTION_CONTINUE;
 			}
 
-			if (Mode == MODE_WIN || Mode == MODE_LOSE)
+			if (Hud.Mode == MODE_WIN || Hud.Mode == MODE_LOSE)
 			{
 				ZL_Color BlackFade = ZLLUMA(0, ZL_Math::Clamp01(ZLSINCESECONDS(EndTicks+500))*.1f);
 				for (float f = 1.f; f > .11f; f -= .05f)
 				{
 					ZL_Display::FillRect(ZL_Rectf(ZLCENTER, ZLCENTER*f), BlackFade);
 				}
-				if (Mode == MODE_WIN)  DrawText(ZLCENTER + ZLV(0, 250), "Congratulations!", .5f, ZL_Origin::Center);
-				if (Mode == MODE_WIN)  DrawText(ZLCENTER + ZLV(0, 170), "You and your crew managed to get home!", .3f, ZL_Origin::Center);
-				if (Mode == MODE_WIN)  DrawText(ZLCENTER + ZLV(0, 50), "YOU WIN", 1.f, ZL_Origin::Center);
-				if (Mode == MODE_LOSE) DrawText(ZLCENTER + ZLV(0, 50), "GAME OVER", 1.f, ZL_Origin::Center);
+				if (Hud.Mode == MODE_WIN)  DrawText(ZLCENTER + ZLV(0, 250), "Congratulations!", .5f, ZL_Origin::Center);
+				if (Hud.Mode == MODE_WIN)  DrawText(ZLCENTER + ZLV(0, 170), "You and your crew managed to get home!", .3f, ZL_Origin::Center);
+				if (Hud.Mode == MODE_WIN)  DrawText(ZLCENTER + ZLV(0, 50), "YOU WIN", 1.f, ZL_Origin::Center);
+				if (Hud.Mode == MODE_LOSE) DrawText(ZLCENTER + ZLV(0, 50), "GAME OVER", 1.f, ZL_Origin::Center);
+				if (Hud.Mode == MODE_LOSE && Hud.Endless) DrawText(ZLCENTER + ZLV(0, 170), ZL_String::format("Distance traveled: %d", (int)Hud.TraveledDistance), .3f, ZL_Origin::Center);
 
 				if (Button(ZL_Rectf(ZLCENTER + ZLV(0, -100), ZLV(200, 30)), "START NEW GAME"))
 				{
-					sndBlip.Play();
-					Start();
+					PendingAction = ACTION_NEWGAME;
 				}
 				if (Button(ZL_Rectf(ZLCENTER + ZLV(0, -200), ZLV(200, 30)), "RETURN TO TITLE"))
 				{
 					FadeTo(FADE_BACKTOTITLE);
 				}
 			}
+			#ifdef COSMIC_BENCHMARK
+			if (IsBenchmarking(BENCH_MENUS)) DrawBenchmarkMenus(BenchScenarios[BenchScenario].Scale);
+			#endif
+		}
+		TextCache.EndFrame();
+
+		PROFILE_PHASE(PROFZONE_FADE);
+		if (FadeMode) ZL_Display::FillRect(0, 0, ZLWIDTH, ZLHEIGHT, ZLLUMA(0, FadeAlpha));
+
+		if (ShowQuality) DrawQualityOverlay();
+		FrameCpuMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - FrameNow).count();
+
+		PROFILE_END_FRAME();
+		#ifdef COSMIC_PROFILER
+		if (ZL_Input::Down(ZLK_F3)) Profiler.ShowOverlay = !Profiler.ShowOverlay;
+		if (Profiler.ShowOverlay) DrawProfilerOverlay();
+		#endif
+	}
+
+	//Pipeline thread: advances the simulation and prepares the planets and render packets of the next frame
+	//Game state changes other than the simulation go through f.Events to the main thread
+	static void PrepareBackFrame() { PrepareFrame(Frames[1 - FrontFrame]); }
+
+	//Stepping stops at a recorded decision, the main thread applies it before the next preparation
+	static bool IsReplayEventDue()
+	{
+		return (Replaying && ReplayNext < Recording.Events.size() && Recording.Events[ReplayNext].Step == SimStepCount);
+	}
+
+	static void PrepareFrame(sRenderFrame& f)
+	{
+		PROFILE_TIME_INTO(PrepareMS);
+		bool Running = (Mode == MODE_RUNNING);
+		if (Running)
+		{
+			//the simulation advances in fixed steps so a run can be recorded and replayed exactly
+			int StepBudget = SIM_STEP_BUDGET;
+			SimAccumulator += PrepareElapsed;
+			if (PrepareFastForward) { SimAccumulator += PrepareElapsed * 49; StepBudget *= 50; }
+			if (SimAccumulator > StepBudget * SimStepSeconds) SimAccumulator = StepBudget * SimStepSeconds;
+		}
+		while (Running && SimAccumulator >= SimStepSeconds && !IsReplayEventDue())
+		{
+			SimAccumulator -= SimStepSeconds;
+			SimPrevPos = Sim.Pos;
+			const float PowerBefore = Sim.Power;
+			eSimEvent Event = Sim.Step(Sim.GetStepMove(SimStepSeconds));
+			SimStepCount++;
+			Running = (Event == SIMEVENT_NONE); //the main thread switches the mode when it gets the event
+			if (Event == SIMEVENT_LANDED)
+			{
+				const sSimPlanetInfo& Info = Sim.Planets.Info[Sim.LandedPlanet];
+				Telemetry.Push(TELEMETRY_LANDED, MODE_LANDED, SimStepCount, Sim.LandedPlanet, Sim.Power, PowerBefore, (float)Info.GainByPower, (float)Info.LoseByEnemy);
+				PushFrameEvent(FRAMEEVENT_LANDED, ToVec3(Sim.Planets.GetPos(Sim.LandedPlanet)));
+			}
+			else if (Event == SIMEVENT_LOSE)
+			{
+				Telemetry.Push(TELEMETRY_LOSE, MODE_LOSE, SimStepCount, -1, Sim.Power, SimStepCount * SimStepSeconds, (float)Sim.GetTraveledDistance());
+				const ZL_Vector3 PlayerPos = ToVec3(Sim.Pos);
+				const float SwayAmount = ZL_Math::Clamp01((2.f - (ZL_Math::Abs(PlayerPos.x) + ZL_Math::Abs(PlayerPos.y))) / 2.f);
+				const ZL_Vector3 Sway = ZL_Vector3(ssin(PlayerPos.z*.5f),scos(PlayerPos.z*2.25f)*.3f,0) * SwayAmount;
+				PushFrameEvent(FRAMEEVENT_LOSE, PlayerPos + Sway);
+			}
+			else if (Event == SIMEVENT_WIN)
+			{
+				Telemetry.Push(TELEMETRY_WIN, MODE_WIN, SimStepCount, -1, Sim.Power, SimStepCount * SimStepSeconds, (float)Sim.GetTraveledDistance());
+				PushFrameEvent(FRAMEEVENT_WIN);
+			}
+		}
+
+		const float StepAlpha = SimAccumulator / SimStepSeconds;
+		const ZL_Vector3 PlayerPos = ToVec3(SimPrevPos) + (ToVec3(Sim.Pos) - ToVec3(SimPrevPos)) * StepAlpha;
+		float ShipSwayAmount = ZL_Math::Clamp01((2.f - (ZL_Math::Abs(PlayerPos.x) + ZL_Math::Abs(PlayerPos.y))) / 2.f);
+		ZL_Vector3 ShipSway = ZL_Vector3(ssin(PlayerPos.z*.5f),scos(PlayerPos.z*2.25f)*.3f,0) * ShipSwayAmount;
+		ZL_Vector3 CameraOffset = ZLV3(-1 + PlayerPos.x, 1, -3);
+		if (Mode == MODE_INTRO)
+		{
+			ZL_Vector CameraXZ = ZL_Vector(CameraOffset.x, CameraOffset.z).Rotate(PrepareSeconds*.5f);
+			CameraOffset = ZL_Vector3(CameraXZ.x, CameraOffset.y, CameraXZ.y) * .5f;
+			ShipSway = ZL_Vector3::Zero;
 		}
+		f.PlayerPos = PlayerPos;
+		f.ShipSway = ShipSway;
+		f.CamPos = PlayerPos + CameraOffset;
+		f.CamDir = -CameraOffset.VecNorm();
+		f.SunPos[0] = SunPos[0];
+		f.SunPos[1] = SunPos[1];
+		CullCamera.SetPosition(f.CamPos);
+		CullCamera.SetDirection(f.CamDir);
 
-		if (FadeMode)
+		//only planets in the z window [-2, 60] around the player are faded in, pickable and rendered
+		if (Mode == MODE_INTRO) { f.WindowFirst = 0; f.WindowEnd = Sim.Planets.Size(); }
+		else Sim.Planets.Range(PlayerPos.z - 2.f, PlayerPos.z + 60.f, f.WindowFirst, f.WindowEnd);
+		if (Mode != MODE_INTRO && ScanPlanet < 0 && Sim.LandedPlanet < 0 && Sim.Power)
 		{
-			if (FadeStart < 0) FadeStart = ZLSECONDS;
-			float t = ZL_Math::Min((ZLSECONDS - FadeStart) * 3.f, 1.f);
-			ZL_Display::FillRect(0, 0, ZLWIDTH, ZLHEIGHT, ZLLUMA(0, (FadeIn ? 1.f - t : t)));
-			if (t == 1.f && !FadeIn)
+			for (int i = f.WindowFirst; i < f.WindowEnd; i++)
 			{
-				FadeIn = true;
-				FadeStart = ZLSECONDS;
-				if (FadeMode == FADE_TOGAME)      Start();
-				if (FadeMode == FADE_BACKTOTITLE) Intro();
-				if (FadeMode == FADE_QUIT)        ZL_Application::Quit();
+				const float itZDist = Sim.Planets.Z[i] - PlayerPos.z;
+				if (itZDist > 30.f) Planets[i].Fade = ZL_Math::Clamp01(ZL_Math::InverseLerp(45.f, 30.f, itZDist));
+				else if (i != Sim.TravelPlanet && i != Sim.LastTravelPlanet && itZDist <  4.f) Planets[i].Fade = ZL_Math::Clamp01(ZL_Math::InverseLerp(1.f, 4.f, itZDist));
+				else Planets[i].Fade = 1.f;
 			}
-			else if (t == 1.f)
+		}
+		CullPlanets(f.WindowFirst, f.WindowEnd, f.CamPos, f.CamDir);
+
+		//only send what changed since the last frame, planets that left the window leave the list
+		const int First = ZL_Math::Min(f.WindowFirst, ListFirst), End = ZL_Math::Min(ZL_Math::Max(f.WindowEnd, ListEnd), (int)Planets.size());
+		for (int i = First; i < End; i++)
+		{
+			sPlanet& p = Planets[i];
+			const bool InList = (i >= f.WindowFirst && i < f.WindowEnd && p.Visible);
+			if (InList == p.InList && (!InList || (p.Lod == p.ListLod && p.Fade == p.ListFade && !p.MtxChanged))) continue;
+			p.InList = InList;
+			p.ListLod = p.Lod;
+			p.ListFade = p.Fade;
+			const sRenderPacket Packet = { p.Mtx, i, p.Lod, p.Fade, InList, p.MtxChanged };
+			p.MtxChanged = false;
+			f.Packets.push_back(Packet);
+		}
+		ListFirst = f.WindowFirst;
+		ListEnd = f.WindowEnd;
+	}
+
+	//Main thread part of taking over a prepared frame, materials of planets in the window get created before their first use
+	static void ApplyFrame(sRenderFrame& f)
+	{
+		for (int i = f.WindowFirst; i < f.WindowEnd; i++)
+			if (!PlanetMaterials[i].Mat) { CreatePlanetMaterial(PlanetMaterials[i], Planets[i]); RenderListDirty = true; }
+		ApplyRenderPackets(f);
+		Camera.SetPosition(f.CamPos);
+		Camera.SetDirection(f.CamDir);
+		Suns[0].SetPosition(f.SunPos[0]);
+		Suns[1].SetPosition(f.SunPos[1]);
+	}
+
+	//Only needed when entries come or go, moved entries just get their referenced matrix updated (batched planets get merged again)
+	static void BuildRenderLists(const sRenderFrame& f)
+	{
+		RenderList.Reset();
+		int PlanetCount = 0, BatchCount = 0;
+		for (vector<sPlanetMaterial>::iterator it = PlanetMaterials.begin(); it != PlanetMaterials.end(); ++it) it->Batch = -1;
+		for (int i = f.WindowFirst; i < f.WindowEnd; i++)
+		{
+			sPlanetMaterial& m = PlanetMaterials[i];
+			if (!m.InList) continue;
+			if (m.Lod < PLANET_BATCH_LOD) { RenderList.AddReferenced(mshPlanetLods[m.Lod], m.Mtx, m.Mat); PlanetCount++; continue; }
+			if (!BatchCount || PlanetBatches[BatchCount - 1].IsFull())
 			{
-				if (FadeMode == FADE_STARTUP) sndSong.Play();
-				FadeMode = FADE_NONE;
-				ZL_Input::RemoveLock();
+				if (BatchCount == (int)PlanetBatches.size()) PlanetBatches.push_back(sPlanetBatch());
+				PlanetBatches[BatchCount++].Begin();
+			}
+			m.Batch = BatchCount - 1;
+			m.Slot = PlanetBatches[m.Batch].Add(PlanetSpheres[m.Lod], m.Mtx, Planets[i].Look, m.Fade);
+		}
+		for (int i = 0; i < BatchCount; i++)
+		{
+			sPlanetBatch& b = PlanetBatches[i];
+			b.End(matPlanetBatch);
+			b.Mat.SetUniformFloat(nmDetail, (float)QualityApplied.NoiseDetail);
+			RenderList.AddReferenced(b.Mesh, ZL_Matrix::Identity);
+		}
+		for (size_t i = BatchCount; i < PlanetBatches.size(); i++) PlanetBatches[i].Begin(); //unused, Update skips empty batches
+		RenderList.AddReferenced(mshSun, MtxSuns[0]);
+		RenderList.AddReferenced(mshSun, MtxSuns[1]);
+		RenderListHasShip = (Sim.Power != 0);
+		if (RenderListHasShip) RenderList.AddReferenced(mshShip, MtxShip);
+		SkyRenderList.Reset();
+		(StarLayersShown ? SkyRenderList : RenderList).AddReferenced(mshSky, MtxSky);
+		RenderListSize = PlanetCount + BatchCount + 2 + RenderListHasShip + !StarLayersShown;
+		SkyRenderListSize = !!StarLayersShown;
+		RenderListDirty = false;
+	}
+
+	//Switches the mode, plays and spawns what happened while the frame was prepared
+	static void ProcessFrameEvents(sRenderFrame& f)
+	{
+		for (vector<sFrameEvent>::iterator e = f.Events.begin(); e != f.Events.end(); ++e)
+		{
+			if (e->Type == FRAMEEVENT_BLIP) sndBlip.Play();
+			else if (e->Type == FRAMEEVENT_LANDED)
+			{
+				Mode = MODE_LANDED;
+				sndBlip.Play();
+				prtDebris.Spawn(40, Camera.WorldToScreen(e->Pos));
+			}
+			else if (e->Type == FRAMEEVENT_LOSE)
+			{
+				Mode = MODE_LOSE;
+				EndTicks = ZLTICKS;
+				sndLose.Play();
+				for (int i = 0; i < 300; i+= 10) prtExplosion.Spawn(10, Camera.WorldToScreen(e->Pos), (float)i);
+				EndRecording(SIMEVENT_LOSE);
+				ClearSnapshot();
+			}
+			else if (e->Type == FRAMEEVENT_WIN)
+			{
+				Mode = MODE_WIN;
+				sndWin.Play();
+				EndTicks = ZLTICKS;
+				EndRecording(SIMEVENT_WIN);
+				ClearSnapshot();
+			}
+		}
+		f.Events.clear();
+	}
+
+	static void CaptureHud(const sRenderFrame& f, int HighlightPlanet)
+	{
+		Hud.Mode = Mode;
+		Hud.Power = Sim.Power;
+		Hud.Endless = Sim.Endless;
+		Hud.TraveledDistance = Sim.GetTraveledDistance();
+		Hud.TimelineZ = (Sim.Endless ? f.PlayerPos.z - 10.f : 0.f);
+		if (Mode == MODE_INTRO) return;
+		if (TimelineDirty || TimelineBakedWidth != ZLWIDTH) BuildTimeline(Hud.TimelineZ);
+		if (ShipIconDirty) BuildShipIcon();
+
+		const int Marked[3] = { HighlightPlanet, ScanPlanet, Sim.TravelPlanet };
+		for (int m = 0; m < 3; m++)
+		{
+			sHudMarker& h = Hud.Marked[m];
+			h.Show = (Marked[m] >= 0 && Sim.Planets.Z[Marked[m]] >= Hud.TimelineZ && Sim.Planets.Z[Marked[m]] <= Hud.TimelineZ + GoalDistance);
+			if (!h.Show) continue;
+			h.Z = Sim.Planets.Z[Marked[m]];
+			h.Radius = Sim.Planets.Radius[Marked[m]];
+			h.Col = Planets[Marked[m]].Col;
+		}
+
+		int RouteVisits[HUD_ROUTE_VISITS];
+		Hud.RouteCount = (ShowRoute ? Route.GetNextVisits(Sim, RouteVisits, HUD_ROUTE_VISITS) : 0);
+		Hud.RouteHasPlan = Route.HasPlan();
+		Hud.RouteSuggestVisit = (Hud.RouteCount && RouteVisits[0] == ScanPlanet);
+		for (int r = 0; r < Hud.RouteCount; r++)
+		{
+			const int i = RouteVisits[r];
+			sHudRouteVisit& h = Hud.Route[r];
+			h.Z = Sim.Planets.Z[i];
+			h.OnScreen = (i >= f.WindowFirst && i < f.WindowEnd && Planets[i].Visible);
+			h.Screen = Planets[i].Screen;
+			h.ScreenRadius = Planets[i].ScreenRadius;
+		}
+
+		if (ScanPlanet >= 0)
+		{
+			Hud.ScanInfo = Sim.Planets.Info[ScanPlanet];
+			Hud.ScanTravel = Sim.CalcTravel(ScanPlanet);
+			Hud.ScanIsTravel = (ScanPlanet == Sim.TravelPlanet);
+		}
+		if (Sim.LandedPlanet >= 0) Hud.LandedInfo = Sim.Planets.Info[Sim.LandedPlanet];
+	}
+
+	static void ApplyPendingAction()
+	{
+		const ePendingAction Action = PendingAction;
+		PendingAction = ACTION_NONE;
+		if      (Action == ACTION_VISIT    && Mode == MODE_SCANNING && !Replaying) VisitAction();
+		else if (Action == ACTION_IGNORE   && Mode == MODE_SCANNING && !Replaying) IgnoreAction(false);
+		else if (Action == ACTION_ABORT    && Mode == MODE_SCANNING && !Replaying) IgnoreAction(true);
+		else if (Action == ACTION_CONTINUE && Mode == MODE_LANDED   && !Replaying) ContinueAction();
+		else if (Action == ACTION_NEWGAME  && (Mode == MODE_WIN || Mode == MODE_LOSE)) { sndBlip.Play(); Start(); }
+	}
+
+	//Fade progress, the game switches at full black before the next frame gets prepared
+	static void UpdateFade()
+	{
+		if (!FadeMode) return;
+		if (FadeStart < 0) FadeStart = ZLSECONDS;
+		float t = ZL_Math::Min((ZLSECONDS - FadeStart) * 3.f, 1.f);
+		FadeAlpha = (FadeIn ? 1.f - t : t);
+		if (t == 1.f && !FadeIn)
+		{
+			FadeIn = true;
+			FadeStart = ZLSECONDS;
+			if (FadeMode == FADE_TOGAME)      Start();
+			if (FadeMode == FADE_BACKTOTITLE) Intro();
+			if (FadeMode == FADE_QUIT)        ZL_Application::Quit();
+		}
+		else if (t == 1.f)
+		{
+			if (FadeMode == FADE_STARTUP && Mode == MODE_INTRO) sndSong.Play();
+			FadeMode = FADE_NONE;
+			ZL_Input::RemoveLock();
+		}
+		if (!FadeIn && FadeMode == FADE_TOGAME)      sndSong.SetSongVolume(  0 + (int)((1.f-t) * 99.f));
+		if ( FadeIn && FadeMode == FADE_BACKTOTITLE) sndSong.SetSongVolume(  0 + (int)((    t) * 99.f));
+		if (!FadeIn && FadeMode == FADE_QUIT)        sndSong.SetSongVolume(-30 + (int)((1.f-t) * 99.f));
+	}
+
+	//Main thread while the pipeline is idle: switches everything that differs from the applied settings (or all with Force)
+	static void ApplyQuality(const sQualitySettings& s, bool Force)
+	{
+		const sQualitySettings Old = QualityApplied;
+		QualityApplied = s;
+		if (Force || s.AA != Old.AA) ZL_Display::SetAA(s.AA);
+		if (Force || s.NoiseDetail != Old.NoiseDetail)
+		{
+			//the fine octave is evaluated by the procedural and the baked material, a bake does not depend on it
+			for (vector<sPlanetMaterial>::iterator it = PlanetMaterials.begin(); it != PlanetMaterials.end(); ++it)
+				if (it->Mat) it->Mat.SetUniformFloat(nmDetail, (float)s.NoiseDetail);
+			for (vector<sPlanetBatch>::iterator it = PlanetBatches.begin(); it != PlanetBatches.end(); ++it)
+				if (it->Mat) it->Mat.SetUniformFloat(nmDetail, (float)s.NoiseDetail);
+		}
+		if (Force || s.SkyDetail != Old.SkyDetail)
+		{
+			mshSky.SetMaterial(0, s.SkyDetail ? matSky : matSkyPlain);
+			StarLayersShown = (s.SkyDetail >= 2 ? StarLayerCount : 0);
+			RenderListDirty = true;
+		}
+		if (Force || s.TextShadows != Old.TextShadows) TextCache.SetShadowPasses(s.TextShadows);
+	}
+
+	static void DrawQualityOverlay()
+	{
+		const sQualitySettings& s = QualityApplied;
+		ZL_Display::FillRect(10, ZLFROMH(80), 620, ZLFROMH(40), ZLLUMA(0, .7));
+		fntMain.Draw(20, ZLFROMH(58), ZL_String::format("Tier %d%s  Frame %.1fms  CPU %.1fms  GPU/wait %.1fms", Quality.Tier, (Quality.IsPinned(QKEY_TIER) ? " (pinned)" : ""),
+			Quality.AvgFrameMS, Quality.AvgCpuMS, ZL_Math::Max(Quality.AvgFrameMS - Quality.AvgCpuMS, 0.f)), .15f);
+		fntMain.Draw(20, ZLFROMH(76), ZL_String::format("AA %d  Planet detail %.2f  Noise detail %d  Sky detail %d  Text shadows %d", (int)s.AA, s.PlanetDetail, s.NoiseDetail, s.SkyDetail, s.TextShadows), .15f);
+	}
+
+	#ifdef COSMIC_BENCHMARK
+	static bool IsBenchmarking(eBenchKind Kind) { return (Benchmarking && BenchScenario >= 0 && BenchScenarios[BenchScenario].Kind == Kind); }
+
+	//Records the frame of the running scenario and moves on to the next one when it has enough frames
+	static void BenchmarkFrame()
+	{
+		if (BenchScenario >= 0)
+		{
+			Bench.EndFrame();
+			if (Bench.RecordedFrames() < BENCH_FRAMES) return;
+			Bench.EndScenario();
+			if (BenchScenarios[BenchScenario].Kind == BENCH_GALAXY) RunMicroBenchmarks(BenchScenarios[BenchScenario].Scale);
+		}
+		if (++BenchScenario == BENCH_SCENARIOS)
+		{
+			Bench.Close();
+			Benchmarking = false;
+			ZL_Application::Quit();
+			return;
+		}
+		const sBenchScenario& s = BenchScenarios[BenchScenario];
+		Sim.Params.GoalDistance = GoalDistance * (s.Kind == BENCH_GALAXY ? s.Scale : 1);
+		FadeMode = FADE_NONE;
+		ZL_Input::SetLock(0);
+		Start();
+		BenchRand.SetSeed(ForcedSeed + BenchScenario);
+		Bench.BeginScenario(s.Name, s.Scale, BENCH_WARMUP_FRAMES, BENCH_FRAMES);
+	}
+
+	//Times the parts of a frame that scale with the galaxy in isolation, runs while the pipeline is idle
+	static void MicroGenerate() { MicroGen->Start(MicroGenSeed++); }
+	static void MicroCull() { const sRenderFrame& f = Frames[FrontFrame]; CullPlanets(f.WindowFirst, f.WindowEnd, f.CamPos, f.CamDir); }
+	static void MicroPicking() { FindHighlightPlanet(Frames[FrontFrame], ZLCENTER); }
+	static void MicroRenderList() { BuildRenderLists(Frames[FrontFrame]); }
+	static void RunMicroBenchmarks(int Scale)
+	{
+		sSimulation Gen;
+		Gen.Params = Sim.Params;
+		MicroGen = &Gen;
+		MicroGenSeed = 1;
+		Bench.Micro("galaxy_generate", Scale, 2000 / Scale + 2, MicroGenerate);
+		Bench.Micro("cull_planets", Scale, 2000, MicroCull);
+		Bench.Micro("highlight_picking", Scale, 20000, MicroPicking);
+		Bench.Micro("render_list_build", Scale, 20000, MicroRenderList);
+	}
+
+	//Fills the screen with columns of menu lines, every tenth line has a number changing each second
+	static void DrawBenchmarkMenus(int Lines)
+	{
+		static const char* Texts[] = { "Chance of Power Supply:", "Chance of Enemy:", "Distance:", "Required Extra Travel Power:", "Found Power Supply:", "Power Lost in Battle:" };
+		const int Rows = (int)(ZLHEIGHT / 24), Columns = (Lines + Rows - 1) / Rows;
+		for (int i = 0; i < Lines; i++)
+		{
+			const ZL_Vector Pos(10 + (i / Rows) * ZLWIDTH / Columns, ZLFROMH(30 + (i % Rows) * 24));
+			if (i % 10) DrawText(Pos, Texts[i % 6], .2f);
+			else DrawText(Pos, ZL_String::format("%d", (i + (int)ZLSECONDS) % 100), .2f);
+		}
+	}
+	#endif
+
+	#ifdef COSMIC_PROFILER
+	static void DrawProfilerOverlay()
+	{
+		ZL_Display::FillRect(10, ZLFROMH(50 + PROFZONE_COUNT * 20), 330, ZLFROMH(40), ZLLUMA(0, .7));
+		fntMain.Draw(20, ZLFROMH(60), "ZONE              P50 MS    P99 MS", .15f);
+		for (int z = 0; z < PROFZONE_COUNT; z++)
+		{
+			const float y = ZLFROMH(80 + z * 20);
+			fntMain.Draw(20, y, ProfileZoneNames[z], .15f);
+			fntMain.Draw(170, y, ZL_String::format("%.2f", Profiler.P50[z]), .15f);
+			fntMain.Draw(250, y, ZL_String::format("%.2f", Profiler.P99[z]), .15f);
+		}
+	}
+	#endif
+
+	//Player decisions go through these so they can be recorded and replayed, main thread only
+	static void ScanAction(int Planet)
+	{
+		if (RecordPath && !Replaying) Recording.Add(SimStepCount, REPLAY_SCAN, Planet);
+		const sSimPlanetInfo& Info = Sim.Planets.Info[Planet];
+		Telemetry.Push(TELEMETRY_SCAN, Mode, SimStepCount, Planet, Sim.Power, (float)Info.ChancePower, (float)Info.ChanceEnemy, Sim.Planets.Z[Planet] - Sim.Pos.z, Sim.CalcTravel(Planet).DrainExtra);
+		PushFrameEvent(FRAMEEVENT_BLIP);
+		Mode = MODE_SCANNING;
+		ScanPlanet = Planet;
+		SnapshotDirty = true;
+	}
+
+	static void VisitAction()
+	{
+		if (RecordPath && !Replaying) Recording.Add(SimStepCount, REPLAY_VISIT, ScanPlanet);
+		Telemetry.Push(TELEMETRY_VISIT, Mode, SimStepCount, ScanPlanet, Sim.Power);
+		PushFrameEvent(FRAMEEVENT_BLIP);
+		Sim.Visit(ScanPlanet);
+		ScanPlanet = -1;
+		Mode = MODE_RUNNING;
+		SnapshotDirty = true;
+	}
+
+	static void IgnoreAction(bool Abort)
+	{
+		if (RecordPath && !Replaying) Recording.Add(SimStepCount, (Abort ? REPLAY_ABORT : REPLAY_IGNORE), ScanPlanet);
+		Telemetry.Push((Abort ? TELEMETRY_ABORT : TELEMETRY_IGNORE), Mode, SimStepCount, ScanPlanet, Sim.Power);
+		PushFrameEvent(FRAMEEVENT_BLIP);
+		if (Abort) Sim.Abort();
+		ScanPlanet = -1;
+		Mode = MODE_RUNNING;
+		SnapshotDirty = true;
+	}
+
+	static void ContinueAction()
+	{
+		if (RecordPath && !Replaying) Recording.Add(SimStepCount, REPLAY_CONTINUE, Sim.LandedPlanet);
+		Telemetry.Push(TELEMETRY_CONTINUE, Mode, SimStepCount, Sim.LandedPlanet, Sim.Power);
+		PushFrameEvent(FRAMEEVENT_BLIP);
+		Sim.Continue();
+		Mode = MODE_RUNNING;
+		SnapshotDirty = true;
+	}
+
+	//Sums up the frame times into a telemetry record every few seconds
+	static void UpdateTelemetry(float FrameMS)
+	{
+		if (!Telemetry.Active) return;
+		#ifndef COSMIC_THREADS
+		Telemetry.Update(ZLELAPSED);
+		#endif
+		TelemetryFrames++;
+		TelemetryFrameSum += FrameMS;
+		if (FrameMS > TelemetryFrameMax) TelemetryFrameMax = FrameMS;
+		if (FrameMS > Quality.TargetMS * 1.5f) TelemetrySlowFrames++;
+		if (TelemetryFrameSum < 5000.f) return;
+		Telemetry.Push(TELEMETRY_FRAMES, Mode, SimStepCount, -1, Sim.Power, (float)TelemetryFrames, TelemetryFrameSum / TelemetryFrames, TelemetryFrameMax, (float)TelemetrySlowFrames);
+		TelemetryFrames = TelemetrySlowFrames = 0;
+		TelemetryFrameSum = TelemetryFrameMax = 0;
+	}
+
+	//Main thread: performs the recorded decisions that were made after the current number of simulation steps
+	static void ApplyReplayEvents()
+	{
+		if (!Replaying || Mode < MODE_RUNNING || Mode > MODE_LANDED) return;
+		for (; ReplayNext < Recording.Events.size() && Recording.Events[ReplayNext].Step == SimStepCount; ReplayNext++)
+		{
+			const sReplayEvent& e = Recording.Events[ReplayNext];
+			if      (e.Type == REPLAY_SCAN)     ScanAction(e.Planet);
+			else if (e.Type == REPLAY_VISIT)    VisitAction();
+			else if (e.Type == REPLAY_IGNORE)   IgnoreAction(false);
+			else if (e.Type == REPLAY_ABORT)    IgnoreAction(true);
+			else if (e.Type == REPLAY_CONTINUE) ContinueAction();
+		}
+	}
+
+	//Saves the recording when a recorded run ends or gets abandoned, a replay switches back to normal play
+	static void EndRecording(eSimEvent Event)
+	{
+		if (Mode < MODE_RUNNING || Mode > MODE_LOSE || (!Replaying && !RecordPath)) return;
+		if (Replaying) { if (Event != SIMEVENT_NONE) Replaying = false; return; }
+		if (Recording.ResultEvent != SIMEVENT_NONE) return; //already saved
+		Recording.SetResult(Event, SimStepCount, Sim.Power);
+		Recording.Save(RecordPath);
+	}
+
+	//Snapshot of a run in progress so it can be resumed if the app gets killed while in the background.
+	//Planets are stored with their look values, the materials get rebuilt when they come into view.
+	static void PutSnapshotVec(sSnapshotWriter& w, const float* v, int n) { for (int i = 0; i < n; i++) w.Put(v[i]); }
+	static void GetSnapshotVec(sSnapshotReader& r, float* v, int n) { for (int i = 0; i < n; i++) r.Get(v[i]); }
+
+	//Job worker: an empty buffer leaves an empty file which fails to load
+	static void WriteSnapshotFile(const char* Path, const void* Data, size_t Size)
+	{
+		ZL_File f(Path, "wb");
+		if (Size) f.Write(Data, Size);
+	}
+
+	static void SaveSnapshot()
+	{
+		SnapshotDirty = false;
+		SnapshotStep = SimStepCount;
+		if (Replaying || RecordPath || Benchmarking) return;
+		static sSnapshotWriter w; //keeps getting the buffer of an older snapshot back from SnapshotFile
+		w.Data.clear();
+		w.Data.reserve(256 + Sim.Planets.Size() * 128);
+		w.Put((unsigned int)SNAPSHOT_MAGIC); w.Put((unsigned int)SNAPSHOT_VERSION);
+		w.Put((int)Mode); w.Put(ScanPlanet); w.Put(SimStepCount); w.Put(SimAccumulator); w.Put(SimPrevPos); w.Put(PlanetVisualRand.State);
+		for (int i = 0; i < 2; i++) { w.Put(SunPos[i].x); w.Put(SunPos[i].y); w.Put(SunPos[i].z); }
+		WriteSimulation(w, Sim);
+		for (vector<sPlanet>::iterator it = Planets.begin(); it != Planets.end(); ++it)
+		{
+			const sPlanetLook& l = it->Look;
+			w.Put(it->RotY);
+			w.Put(it->Col.r); w.Put(it->Col.g); w.Put(it->Col.b); w.Put(it->Col.a);
+			PutSnapshotVec(w, l.ColA, 3); PutSnapshotVec(w, l.ColB, 3); PutSnapshotVec(w, l.ColW, 3); PutSnapshotVec(w, l.ColC, 3);
+			w.Put(l.FacS); w.Put(l.FacW); w.Put(l.FacC);
+		}
+		SnapshotFile.Write(w.Data);
+		SnapshotStored = true;
+	}
+
+	static void ClearSnapshot()
+	{
+		if (!SnapshotStored) return;
+		SnapshotFile.Clear();
+		SnapshotStored = false;
+	}
+
+	static bool RestoreSnapshot()
+	{
+		std::vector<unsigned char> Data;
+		{
+			ZL_File f(SnapshotPath, "rb");
+			if (!f) return false;
+			Data.resize(f.Size());
+			if (!Data.empty() && f.Read(&Data[0], Data.size()) != Data.size()) Data.clear();
+		}
+		if (ReadSnapshot(Data)) return true;
+		SnapshotFile.Clear(); //a snapshot that can't be resumed would otherwise be tried again on every start
+		SnapshotStored = false;
+		return false;
+	}
+
+	static bool ReadSnapshot(const std::vector<unsigned char>& Data)
+	{
+		if (Data.empty()) return false;
+		sSnapshotReader r(&Data[0], Data.size());
+		unsigned int Magic = 0, Version = 0;
+		int SavedMode = 0;
+		ZL_Vector3 SavedSunPos[2];
+		r.Get(Magic); r.Get(Version);
+		if (Magic != SNAPSHOT_MAGIC || Version != SNAPSHOT_VERSION) return false;
+		r.Get(SavedMode); r.Get(ScanPlanet); r.Get(SimStepCount); r.Get(SimAccumulator); r.Get(SimPrevPos); r.Get(PlanetVisualRand.State);
+		for (int i = 0; i < 2; i++) { r.Get(SavedSunPos[i].x); r.Get(SavedSunPos[i].y); r.Get(SavedSunPos[i].z); }
+		if (!ReadSimulation(r, Sim)) return false;
+		const int Count = Sim.Planets.Size();
+		if (SavedMode < MODE_RUNNING || SavedMode > MODE_LANDED || ScanPlanet >= Count || (SavedMode == MODE_SCANNING) != (ScanPlanet >= 0) || (SavedMode == MODE_LANDED && Sim.LandedPlanet < 0)) return false;
+		Planets.resize(Count);
+		for (int i = 0; i < Count; i++)
+		{
+			sPlanetLook& l = Planets[i].Look;
+			r.Get(Planets[i].RotY);
+			r.Get(Planets[i].Col.r); r.Get(Planets[i].Col.g); r.Get(Planets[i].Col.b); r.Get(Planets[i].Col.a);
+			GetSnapshotVec(r, l.ColA, 3); GetSnapshotVec(r, l.ColB, 3); GetSnapshotVec(r, l.ColW, 3); GetSnapshotVec(r, l.ColC, 3);
+			r.Get(l.FacS); r.Get(l.FacW); r.Get(l.FacC);
+			Planets[i].Fade = 1.f;
+			Planets[i].Lod = PLANET_LODS - 1;
+			UpdatePlanetMatrix(i);
+		}
+		if (!r.Ok) { Planets.clear(); return false; }
+
+		Mode = (eGameMode)SavedMode;
+		EndlessMode = Sim.Endless;
+		SelectShip(Sim.Seed);
+		SunPos[0] = SavedSunPos[0];
+		SunPos[1] = SavedSunPos[1];
+		Route.Reset();
+		TimelineDirty = FrameStale = true;
+		SnapshotStored = true;
+		SnapshotStep = SimStepCount;
+		return true;
+	}
+
+	static float GetTimelineX(float Z, float TimelineZ)
+	{
+		return ZL_Math::Lerp(150, ZLFROMW(15), ZL_Math::InverseLerp(TimelineZ, TimelineZ + GoalDistance, Z));
+	}
+
+	//Renders the planet circles of the progress timeline into a surface which gets scrolled by the z offset to TimelineBakedZ
+	static void BuildTimeline(float TimelineZ)
+	{
+		const float BarWidth = ZLFROMW(15) - 150, ToSurface = TIMELINE_MARGIN - 150.f;
+		srfTimeline = ZL_Surface((int)BarWidth + TIMELINE_MARGIN * 2, 30, true);
+		srfTimeline.RenderToBegin(true);
+		int First, End;
+		Sim.Planets.Range(TimelineZ - (Sim.Endless ? GoalDistance : 0.f), TimelineZ + GoalDistance, First, End);
+		for (int i = First; i < End; i++)
+			ZL_Display::DrawCircle(ToSurface + GetTimelineX(Sim.Planets.Z[i], TimelineZ), 15, 4 * Sim.Planets.Radius[i], ZL_Color::Gray, Planets[i].Col);
+		if (!Sim.Endless)
+		{
+			ZL_Display::DrawCircle(ToSurface + ZLFROMW(15), 15, 10, ZL_Color::White, ZL_Color::Black);
+			ZL_Display::DrawCircle(ToSurface + ZLFROMW(15), 15, 7, ZL_Color::White, ZL_Color::Black);
+			ZL_Display::DrawCircle(ToSurface + ZLFROMW(15), 15, 4, ZL_Color::White, ZL_Color::Black);
+		}
+		srfTimeline.RenderToEnd();
+		TimelineBakedZ = TimelineZ;
+		TimelineBakedWidth = ZLWIDTH;
+		TimelineDirty = false;
+	}
+
+	//The timeline ship marker used to be the ship drawn 5 times over itself, do that once into a surface
+	static void BuildShipIcon()
+	{
+		const int w = srfShip.GetWidth() * 2, h = srfShip.GetHeight() * 2;
+		srfShipIcon = ZL_Surface(w, h, true);
+		srfShipIcon.RenderToBegin(true);
+		for (int i = 0; i < 5; i++) srfShip.Draw(w * .5f, h * .5f);
+		srfShipIcon.RenderToEnd();
+		srfShipIcon.SetOrigin(ZL_Origin::Center);
+		ShipIconDirty = false;
+	}
+
+	static void DrawStarLayers(float ViewZ)
+	{
+		srfStar.BatchRenderBegin(true);
+		for (int l = 0; l < StarLayersShown; l++)
+		{
+			const sStarLayer& Layer = StarLayers[l];
+			const float Size = (l ? .4f : .25f);
+			for (int i = 0; i < (int)Layer.Stars.size(); i++)
+			{
+				float Alpha;
+				bool IsOutsideOfView;
+				const ZL_Vector StarOnScreen = Camera.WorldToScreen(ToVec3(Layer.GetPos(i, ViewZ, Alpha)), &IsOutsideOfView);
+				if (IsOutsideOfView || Alpha <= 0) continue;
+				srfStar.Draw(StarOnScreen.x, StarOnScreen.y, Size, Size, ZLLUMA(Layer.Brightness[i], Alpha));
 			}
-			if (!FadeIn && FadeMode == FADE_TOGAME)      sndSong.SetSongVolume(  0 + (int)((1.f-t) * 99.f));
-			if ( FadeIn && FadeMode == FADE_BACKTOTITLE) sndSong.SetSongVolume(  0 + (int)((    t) * 99.f));
-			if (!FadeIn && FadeMode == FADE_QUIT)        sndSong.SetSongVolume(-30 + (int)((1.f-t) * 99.f));
 		}
+		srfStar.BatchRenderEnd();
 	}
 
 	static void DrawText(const ZL_Vector &p, const char *text, scalar scale, ZL_Origin::Type draw_at_origin = ZL_Origin::BottomLeft, const ZL_Color& color = ZL_Color::White)
 	{
-		TextBuffer.SetText(text);
-		for (int i = -4; i <= 4; i++) if (i) TextBuffer.Draw(p + ZLV(i/3, i%3), scale, ZLLUMA(0,.5), draw_at_origin);
-		TextBuffer.Draw(p, scale, color, draw_at_origin);
+		TextCache.Draw(p, text, scale, draw_at_origin, color);
+		BENCH_DRAWS(1);
 	}
 
 	static bool Button(const ZL_Rectf& Rec, const char* Text)
@@ -571,7 +1693,7 @@ static TImcSongData imcDataIMCSONG = {
 	/*LEN*/ 0x4, /*ROWLENSAMPLES*/ 5512, /*ENVLISTSIZE*/ 14, /*ENVCOUNTERLISTSIZE*/ 17, /*OSCLISTSIZE*/ 17, /*EFFECTLISTSIZE*/ 7, /*VOL*/ 100,
 	IMCSONG_OrderTable, IMCSONG_PatternData, IMCSONG_PatternLookupTable, IMCSONG_EnvList, IMCSONG_EnvCounterList, IMCSONG_OscillatorList, IMCSONG_EffectList,
 	IMCSONG_ChannelVol, IMCSONG_ChannelEnvCounter, IMCSONG_ChannelStopNote };
-ZL_SynthImcTrack sndSong = ZL_SynthImcTrack(&imcDataIMCSONG);
+sMusicTrack sndSong(&imcDataIMCSONG, sizeof(IMCSONG_PatternData));
 
 static const unsigned int IMCWIN_OrderTable[] = { 0x011000001, 0x002000000, };
 static const unsigned char IMCWIN_PatternData[] = { 0x50, 0, 0x50, 0x50, 0x50, 0, 0x54, 0, 0x50, 0, 0x52, 0, 0x55, 0, 0, 0, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0x50, 0, 0, 0,
@@ -584,7 +1706,7 @@ static TImcSongData imcDataIMCWIN = {
 	/*LEN*/ 0x2, /*ROWLENSAMPLES*/ 5512, /*ENVLISTSIZE*/ 14, /*ENVCOUNTERLISTSIZE*/ 17, /*OSCLISTSIZE*/ 17, /*EFFECTLISTSIZE*/ 7, /*VOL*/ 100,
 	IMCWIN_OrderTable, IMCWIN_PatternData, IMCWIN_PatternLookupTable, IMCSONG_EnvList, IMCSONG_EnvCounterList, IMCSONG_OscillatorList, IMCSONG_EffectList,
 	IMCWIN_ChannelVol, IMCWIN_ChannelEnvCounter, IMCWIN_ChannelStopNote };
-ZL_SynthImcTrack sndWin = ZL_SynthImcTrack(&imcDataIMCWIN, false);
+sMusicTrack sndWin(&imcDataIMCWIN, sizeof(IMCWIN_PatternData), false);
 
 static const unsigned int IMCLOSE_OrderTable[] = { 0x011000001, 0x002000005, };
 static const unsigned char IMCLOSE_PatternData[] = { 0x55, 0, 0x57, 0, 0x54, 0, 0x57, 0, 0x52, 0, 0, 0, 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -598,7 +1720,7 @@ static TImcSongData imcDataIMCLOSE = {
 	/*LEN*/ 0x2, /*ROWLENSAMPLES*/ 5512, /*ENVLISTSIZE*/ 14, /*ENVCOUNTERLISTSIZE*/ 17, /*OSCLISTSIZE*/ 17, /*EFFECTLISTSIZE*/ 7, /*VOL*/ 100,
 	IMCLOSE_OrderTable, IMCLOSE_PatternData, IMCLOSE_PatternLookupTable, IMCSONG_EnvList, IMCSONG_EnvCounterList, IMCSONG_OscillatorList, IMCSONG_EffectList,
 	IMCLOSE_ChannelVol, IMCLOSE_ChannelEnvCounter, IMCLOSE_ChannelStopNote };
-ZL_SynthImcTrack sndLose = ZL_SynthImcTrack(&imcDataIMCLOSE, false);
+sMusicTrack sndLose(&imcDataIMCLOSE, sizeof(IMCLOSE_PatternData), false);
 
 static const unsigned int IMCBLIP_OrderTable[] = { 0x000000001, };
 static const unsigned char IMCBLIP_PatternData[] = { 0x5B, 0x62, 0x60, 255, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, };
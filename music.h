@@ -0,0 +1,170 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_MUSIC_
+#define _COSMICINFLUX_MUSIC_
+
+// ImcSynth tracks pre-rendered into WAV samples by a job (or read from a cache file named by a hash
+// of the song data), synthesized live until the sample is ready or with -livemusic.
+
+#include <ZL_Audio.h>
+#include <ZL_SynthImc.h>
+#include "jobs.h"
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+enum { MUSIC_RATE = 44100, MUSIC_CHANNELS = 2, MUSIC_PATTERN_ROWS = 16, MUSIC_WAV_HEADER = 44, MUSIC_CACHE_VERSION = 1 };
+
+//Render job state, owned by the job until Done is set
+struct sMusicRender
+{
+	TImcSongData Song; //private copy, the synthesizer writes into the envelope counters and channel volumes
+	std::vector<TImcSongEnvelopeCounter> EnvCounters;
+	unsigned char ChannelVol[8];
+	char CachePath[48];
+	std::vector<unsigned char> Wav;
+	std::atomic<bool> Done;
+
+	sMusicRender(const TImcSongData& SongData, const TImcSongEnvelopeCounter* SongEnvCounters, const unsigned char* SongChannelVol, unsigned int Hash) : Song(SongData), EnvCounters(SongEnvCounters, SongEnvCounters + SongData.ENVCOUNTERLISTSIZE), Done(false)
+	{
+		memcpy(ChannelVol, SongChannelVol, sizeof(ChannelVol));
+		Song.EnvCounterList = &EnvCounters[0];
+		Song.ChannelVol = ChannelVol;
+		sprintf(CachePath, "CosmicInflux.music.%08x.wav", Hash);
+	}
+
+	void WriteHeader(unsigned int DataSize)
+	{
+		unsigned char* h = &Wav[0];
+		const unsigned int Fields[] = { 0x46464952, 36 + DataSize, 0x45564157, 0x20746D66, 16, 1 | (MUSIC_CHANNELS << 16), MUSIC_RATE, MUSIC_RATE * MUSIC_CHANNELS * 2, (MUSIC_CHANNELS * 2) | (16 << 16), 0x61746164, DataSize }; //RIFF WAVE fmt PCM 16-bit data
+		for (int i = 0; i < 11; i++, h += 4) { h[0] = (unsigned char)Fields[i]; h[1] = (unsigned char)(Fields[i] >> 8); h[2] = (unsigned char)(Fields[i] >> 16); h[3] = (unsigned char)(Fields[i] >> 24); }
+	}
+
+	static void Job(void* Data, int)
+	{
+		sMusicRender* r = (sMusicRender*)Data;
+		const unsigned int Frames = (unsigned int)(r->Song.LEN * MUSIC_PATTERN_ROWS * r->Song.ROWLENSAMPLES), DataSize = Frames * MUSIC_CHANNELS * 2;
+		r->Wav.resize(MUSIC_WAV_HEADER + DataSize);
+		r->WriteHeader(DataSize);
+		unsigned char Header[MUSIC_WAV_HEADER];
+		memcpy(Header, &r->Wav[0], MUSIC_WAV_HEADER);
+		ZL_File Cached(r->CachePath, "rb");
+		if (!Cached || Cached.Size() != r->Wav.size() || Cached.Read(&r->Wav[0], r->Wav.size()) != r->Wav.size() || memcmp(Header, &r->Wav[0], MUSIC_WAV_HEADER))
+		{
+			Cached.Close();
+			memcpy(&r->Wav[0], Header, MUSIC_WAV_HEADER);
+			ZL_SynthImcTrack::RenderSamples(&r->Song, (short*)&r->Wav[MUSIC_WAV_HEADER], Frames);
+			ZL_File(r->CachePath, "wb").Write(&r->Wav[0], r->Wav.size());
+		}
+		r->Done = true;
+	}
+};
+
+struct sMusicTrack
+{
+	ZL_SynthImcTrack Live;
+	ZL_Sound Sample;
+	bool SampleReady, Loop, PlayingSample;
+	int Volume;
+	sMusicRender* Render;
+
+	//Song tables as they were before anything played, live playback writes into the shared ones
+	TImcSongData* SongData;
+	std::vector<TImcSongEnvelopeCounter> SongEnvCounters;
+	unsigned char SongChannelVol[8];
+	unsigned int Hash;
+
+	sMusicTrack(TImcSongData* SongData, size_t PatternDataSize, bool LoopSong = true) : Live(SongData, LoopSong), SampleReady(false), Loop(LoopSong), PlayingSample(false), Volume(100), Render(NULL), SongData(SongData)
+	{
+		SongEnvCounters.assign(SongData->EnvCounterList, SongData->EnvCounterList + SongData->ENVCOUNTERLISTSIZE);
+		memcpy(SongChannelVol, SongData->ChannelVol, sizeof(SongChannelVol));
+		const TImcSongData& s = *SongData;
+		const int Sizes[] = { s.LEN, s.ROWLENSAMPLES, s.ENVLISTSIZE, s.ENVCOUNTERLISTSIZE, s.OSCLISTSIZE, s.EFFECTLISTSIZE, s.VOL, MUSIC_CACHE_VERSION };
+		Hash = 2166136261u;
+		AddHash(Sizes, sizeof(Sizes));
+		AddHash(s.OrderTable, s.LEN * sizeof(s.OrderTable[0]));
+		AddHash(s.PatternData, PatternDataSize);
+		AddHash(s.PatternLookupTable, 8);
+		AddHash(s.EnvList, s.ENVLISTSIZE * sizeof(s.EnvList[0]));
+		AddHash(&SongEnvCounters[0], s.ENVCOUNTERLISTSIZE * sizeof(SongEnvCounters[0]));
+		AddHash(s.OscillatorList, s.OSCLISTSIZE * sizeof(s.OscillatorList[0]));
+		AddHash(s.EffectList, s.EFFECTLISTSIZE * sizeof(s.EffectList[0]));
+		AddHash(SongChannelVol, 8);
+		AddHash(s.ChannelEnvCounter, 8);
+		AddHash(s.ChannelStopNote, 8 * sizeof(s.ChannelStopNote[0]));
+	}
+
+	//A job still rendering keeps its state, it can only be left behind when quitting during startup
+	~sMusicTrack() { if (Render && Render->Done) delete Render; }
+
+	void AddHash(const void* Data, size_t Size)
+	{
+		for (size_t i = 0; i < Size; i++) Hash = (Hash ^ ((const unsigned char*)Data)[i]) * 16777619u; //FNV-1a
+	}
+
+	//Queues the render, without worker threads the track stays live as rendering a song in one job would hitch
+	void StartRender()
+	{
+		#ifdef COSMIC_THREADS
+		if (Render || SampleReady) return;
+		Render = new sMusicRender(*SongData, &SongEnvCounters[0], SongChannelVol, Hash);
+		Jobs.Add(sMusicRender::Job, Render);
+		#endif
+	}
+
+	//Main thread: creates the sample once the render is done, a track already playing switches on the next Play
+	void Update()
+	{
+		if (!Render || !Render->Done) return;
+		Sample = ZL_Sound(ZL_File(&Render->Wav[0], Render->Wav.size()));
+		SampleReady = !!Sample;
+		delete Render;
+		Render = NULL;
+	}
+
+	void Play()
+	{
+		Stop();
+		PlayingSample = SampleReady;
+		if (PlayingSample) { ApplySampleVolume(); Sample.Play(Loop); }
+		else { Live.SetSongVolume(Volume); Live.Play(); }
+	}
+
+	void Stop()
+	{
+		if (PlayingSample) Sample.Stop();
+		else Live.Stop();
+	}
+
+	//Same range as ZL_SynthImcTrack::SetSongVolume (100 is the volume the sample was rendered with)
+	void SetSongVolume(int NewVolume)
+	{
+		Volume = NewVolume;
+		if (PlayingSample) ApplySampleVolume();
+		else Live.SetSongVolume(Volume);
+	}
+
+	void ApplySampleVolume() { Sample.SetVolume(Volume <= 0 ? 0.f : (Volume >= 100 ? 1.f : Volume / 100.f)); }
+};
+
+#endif //_COSMICINFLUX_MUSIC_
@@ -0,0 +1,183 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_PARTICLES_
+#define _COSMICINFLUX_PARTICLES_
+
+// Structure of arrays particle system updated 4 particles at a time with sF4 and drawn as one triangle list per system.
+// Large systems split the update into chunks that the main thread and the job workers claim from a counter.
+
+#include <ZL_Surface.h>
+#include "planetbake.h"
+#include "simulation.h"
+#include <vector>
+#include <atomic>
+#include <limits.h>
+#include <string.h>
+
+struct sParticleSystem
+{
+	enum { THREAD_MIN_PARTICLES = 32768, THREAD_CHUNK = 16384, QUAD_VERTICES = 6 }; //THREAD_CHUNK must be a multiple of 4
+
+	ZL_Surface Srf;
+	float LifeTime, Speed, SpeedVariation, AlphaStart, AlphaEnd, ScaleStart, ScaleEnd;
+	std::vector<ZL_Color> StartColors;
+	ZL_Color EndColor;
+	int Count, Capacity;
+
+	//Particle state, arrays are padded to a multiple of 4 for the sF4 loops
+	std::vector<float> X, Y, VX, VY, T, RotC, RotS, R0, G0, B0; //T is the age in [0,1] of the life time, RotC/RotS the cosine and sine of the image rotation
+	std::vector<float> R, G, B, A, Scale; //written by Update
+	std::vector<float> Positions, TexCoords, Colors; //QUAD_VERTICES per particle, written by Update, read by Draw
+	float HalfW, HalfH; //half the image size
+	sSimRand Rand;
+	float StepElapsed;
+	int Chunks;
+	std::atomic<int> NextChunk, ChunksLeft; //chunk claim and completion counters of a threaded update
+
+	sParticleSystem() : LifeTime(1), Speed(0), SpeedVariation(0), AlphaStart(1), AlphaEnd(1), ScaleStart(1), ScaleEnd(1), EndColor(ZL_Color::White), Count(0), Capacity(0), HalfW(0), HalfH(0), Rand(1), StepElapsed(0), Chunks(0), NextChunk(INT_MAX / 2), ChunksLeft(0) { }
+
+	void Init(const ZL_Surface& Surface, int MaxParticles, float LifeSeconds)
+	{
+		Srf = Surface;
+		HalfW = Srf.GetWidth() * .5f;
+		HalfH = Srf.GetHeight() * .5f;
+		LifeTime = LifeSeconds;
+		Capacity = MaxParticles;
+		Count = 0;
+		StartColors.clear();
+		const size_t Padded = (size_t)((MaxParticles + 3) & ~3);
+		std::vector<float>* Arrays[] = { &X, &Y, &VX, &VY, &T, &RotC, &RotS, &R0, &G0, &B0, &R, &G, &B, &A, &Scale };
+		for (size_t i = 0; i < sizeof(Arrays)/sizeof(Arrays[0]); i++) Arrays[i]->assign(Padded, 0.f);
+		Positions.assign(Padded * QUAD_VERTICES * 2, 0.f);
+		Colors.assign(Padded * QUAD_VERTICES * 4, 0.f);
+		TexCoords.resize(Padded * QUAD_VERTICES * 2);
+		static const float QuadTex[QUAD_VERTICES * 2] = { 0,1, 1,1, 0,0, 1,1, 1,0, 0,0 };
+		for (size_t i = 0; i < Padded; i++) memcpy(&TexCoords[i * QUAD_VERTICES * 2], QuadTex, sizeof(QuadTex));
+	}
+
+	sParticleSystem& SetMove(float MoveSpeed, float MoveSpeedVariation = 0) { Speed = MoveSpeed; SpeedVariation = MoveSpeedVariation; return *this; }
+	sParticleSystem& AddStartColor(const ZL_Color& c) { StartColors.push_back(c); return *this; }
+	sParticleSystem& SetEndColor(const ZL_Color& c) { EndColor = c; return *this; }
+	sParticleSystem& SetAlpha(float Start, float End) { AlphaStart = Start; AlphaEnd = End; return *this; }
+	sParticleSystem& SetScale(float Start, float End) { ScaleStart = Start; ScaleEnd = End; return *this; }
+
+	//Spawns Num particles at screen position Pos drawn with image rotation Rotation (particles over the capacity are dropped)
+	void Spawn(int Num, const ZL_Vector& Pos, float Rotation = 0)
+	{
+		for (; Num > 0 && Count < Capacity; Num--, Count++)
+		{
+			const float Angle = Rand.Range(0, 6.2831853f), Vel = Speed + Rand.Range(-SpeedVariation, SpeedVariation);
+			const ZL_Color& c = (StartColors.empty() ? ZL_Color::White : StartColors[Rand.UInt() % StartColors.size()]);
+			X[Count] = Pos.x; Y[Count] = Pos.y; VX[Count] = cosf(Angle) * Vel; VY[Count] = sinf(Angle) * Vel;
+			T[Count] = 0; RotC[Count] = cosf(Rotation); RotS[Count] = sinf(Rotation); R0[Count] = c.r; G0[Count] = c.g; B0[Count] = c.b;
+			R[Count] = c.r; G[Count] = c.g; B[Count] = c.b; A[Count] = AlphaStart; Scale[Count] = ScaleStart;
+		}
+	}
+
+	void Update(float Elapsed)
+	{
+		//particles that reached the end of their life last update are replaced with the last one
+		for (int i = 0; i < Count;)
+		{
+			if (T[i] < 1.f) { i++; continue; }
+			const int l = --Count;
+			X[i] = X[l]; Y[i] = Y[l]; VX[i] = VX[l]; VY[i] = VY[l]; T[i] = T[l]; RotC[i] = RotC[l]; RotS[i] = RotS[l]; R0[i] = R0[l]; G0[i] = G0[l]; B0[i] = B0[l];
+		}
+		if (!Count) return;
+		StepElapsed = Elapsed;
+		const int End = (Count + 3) & ~3;
+		#ifdef COSMIC_THREADS
+		if (Count >= THREAD_MIN_PARTICLES)
+		{
+			Chunks = (End + THREAD_CHUNK - 1) / THREAD_CHUNK;
+			ChunksLeft.store(Chunks, std::memory_order_relaxed);
+			NextChunk.store(0, std::memory_order_release);
+			Jobs.Add(UpdateJob, this, Chunks - 1);
+			while (ClaimChunk()) { } //the main thread works through chunks itself until all are claimed
+			while (ChunksLeft.load(std::memory_order_acquire)) std::this_thread::yield(); //only waits for chunks being updated right now
+			NextChunk.store(INT_MAX / 2, std::memory_order_relaxed); //jobs still in the queue find nothing to claim
+			return;
+		}
+		#endif
+		UpdateRange(0, End);
+	}
+
+	//Updates the next unclaimed chunk, returns false when all chunks were claimed
+	bool ClaimChunk()
+	{
+		const int Chunk = NextChunk.fetch_add(1, std::memory_order_acquire);
+		if (Chunk >= INT_MAX / 4 || Chunk >= Chunks) return false; //check the idle value first, Chunks gets rewritten by the next update
+		const int End = (Count + 3) & ~3, First = Chunk * THREAD_CHUNK;
+		UpdateRange(First, (First + THREAD_CHUNK < End ? First + THREAD_CHUNK : End));
+		ChunksLeft.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	static void UpdateJob(void* Data, int)
+	{
+		while (((sParticleSystem*)Data)->ClaimChunk()) { }
+	}
+
+	void UpdateRange(int First, int End)
+	{
+		const sF4 dt(StepElapsed), dAge(StepElapsed / LifeTime), One(1.f);
+		const sF4 As(AlphaStart), Ad(AlphaEnd - AlphaStart), Ss(ScaleStart), Sd(ScaleEnd - ScaleStart), Er(EndColor.r), Eg(EndColor.g), Eb(EndColor.b);
+		for (int i = First; i < End; i += 4)
+		{
+			//linear move
+			(sF4::Load(&X[i]) + sF4::Load(&VX[i]) * dt).Store(&X[i]);
+			(sF4::Load(&Y[i]) + sF4::Load(&VY[i]) * dt).Store(&Y[i]);
+			const sF4 t = sF4::Min(sF4::Load(&T[i]) + dAge, One);
+			t.Store(&T[i]);
+			//alpha and scale curves
+			(As + Ad * t).Store(&A[i]);
+			(Ss + Sd * t).Store(&Scale[i]);
+			//colour ramp
+			const sF4 r0 = sF4::Load(&R0[i]), g0 = sF4::Load(&G0[i]), b0 = sF4::Load(&B0[i]);
+			(r0 + (Er - r0) * t).Store(&R[i]);
+			(g0 + (Eg - g0) * t).Store(&G[i]);
+			(b0 + (Eb - b0) * t).Store(&B[i]);
+		}
+		//quad corners, placed like ZL_Surface::Draw with a bottom left origin rotated around the image center
+		for (int i = First, Last = (End < Count ? End : Count); i < Last; i++)
+		{
+			const float hw = HalfW * Scale[i], hh = HalfH * Scale[i], cx = X[i] + hw, cy = Y[i] + hh;
+			const float ax = RotC[i] * hw, ay = RotS[i] * hw, bx = -RotS[i] * hh, by = RotC[i] * hh; //rotated half axes
+			const float Corners[8] = { cx-ax-bx, cy-ay-by, cx+ax-bx, cy+ay-by, cx-ax+bx, cy-ay+by, cx+ax+bx, cy+ay+by };
+			static const int QuadCorner[QUAD_VERTICES] = { 0, 1, 2, 1, 3, 2 };
+			float *p = &Positions[i * QUAD_VERTICES * 2], *c = &Colors[i * QUAD_VERTICES * 4];
+			for (int v = 0; v < QUAD_VERTICES; v++, p += 2, c += 4)
+			{
+				p[0] = Corners[QuadCorner[v] * 2]; p[1] = Corners[QuadCorner[v] * 2 + 1];
+				c[0] = R[i]; c[1] = G[i]; c[2] = B[i]; c[3] = A[i];
+			}
+		}
+	}
+
+	void Draw()
+	{
+		if (!Count) return;
+		Srf.DrawTriangles(&Positions[0], &TexCoords[0], &Colors[0], Count * QUAD_VERTICES);
+	}
+};
+
+#endif //_COSMICINFLUX_PARTICLES_
@@ -0,0 +1,97 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_PIPELINE_
+#define _COSMICINFLUX_PIPELINE_
+
+// Prepares the next frame (simulation and visibility, no GL, audio or input calls) on its own thread while the main thread draws.
+// Between Kick() and Wait() the main thread must not touch the simulation, the prepared frame or the planet visibility fields.
+
+#include "jobs.h"
+
+typedef void (*PrepareFunc)();
+
+static struct sFramePipeline
+{
+	PrepareFunc Prepare;
+	bool Pending;
+
+	#ifdef COSMIC_THREADS
+	std::thread Worker;
+	std::mutex Mutex;
+	std::condition_variable Signal, Done;
+	bool Quit;
+
+	sFramePipeline() : Prepare(NULL), Pending(false), Quit(false) { }
+	~sFramePipeline() { Shutdown(); }
+
+	void Init(PrepareFunc Func)
+	{
+		Prepare = Func;
+		if (!Worker.joinable()) Worker = std::thread(WorkerMain, this);
+	}
+
+	//Lets a running preparation finish and stops the thread
+	void Shutdown()
+	{
+		if (!Worker.joinable()) return;
+		{ std::lock_guard<std::mutex> Lock(Mutex); Quit = true; }
+		Signal.notify_one();
+		Worker.join();
+		Quit = Pending = false;
+	}
+
+	void Kick()
+	{
+		{ std::lock_guard<std::mutex> Lock(Mutex); Pending = true; }
+		Signal.notify_one();
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> Lock(Mutex);
+		while (Pending) Done.wait(Lock);
+	}
+
+	static void WorkerMain(sFramePipeline* p)
+	{
+		std::unique_lock<std::mutex> Lock(p->Mutex);
+		for (;;)
+		{
+			while (!p->Quit && !p->Pending) p->Signal.wait(Lock);
+			if (!p->Pending) return;
+			Lock.unlock();
+			p->Prepare();
+			Lock.lock();
+			p->Pending = false;
+			p->Done.notify_one();
+		}
+	}
+	#else
+	sFramePipeline() : Prepare(NULL), Pending(false) { }
+	void Init(PrepareFunc Func) { Prepare = Func; }
+	void Shutdown() { Pending = false; }
+	void Kick() { Pending = true; }
+	void Wait() { if (Pending) { Pending = false; Prepare(); } }
+	#endif
+} Pipeline;
+
+#endif //_COSMICINFLUX_PIPELINE_
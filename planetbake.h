@@ -0,0 +1,223 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_PLANETBAKE_
+#define _COSMICINFLUX_PLANETBAKE_
+
+// CPU version of the procedural planet shader rendered into an RGBA texture, 4 texels at a time with SSE2/NEON.
+// The fine darkening octave is too fine for the texture, alpha stores its strength and the baked material adds it per fragment.
+
+#include "jobs.h"
+#include <vector>
+#include <atomic>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+struct sF4
+{
+	__m128 v;
+	sF4() { }
+	sF4(__m128 v) : v(v) { }
+	sF4(float f) : v(_mm_set1_ps(f)) { }
+	sF4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) { }
+	sF4 operator+(const sF4& o) const { return _mm_add_ps(v, o.v); }
+	sF4 operator-(const sF4& o) const { return _mm_sub_ps(v, o.v); }
+	sF4 operator*(const sF4& o) const { return _mm_mul_ps(v, o.v); }
+	void Store(float* Out) const { _mm_storeu_ps(Out, v); }
+	static sF4 Load(const float* In) { return _mm_loadu_ps(In); }
+	static sF4 Max(const sF4& a, const sF4& b) { return _mm_max_ps(a.v, b.v); }
+	static sF4 Min(const sF4& a, const sF4& b) { return _mm_min_ps(a.v, b.v); }
+	static sF4 Abs(const sF4& a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+	static sF4 Floor(const sF4& a) { __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)); return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f))); }
+	static sF4 Greater(const sF4& a, const sF4& b) { return _mm_and_ps(_mm_cmpgt_ps(a.v, b.v), _mm_set1_ps(1.f)); } //1 or 0 per lane
+};
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+struct sF4
+{
+	float32x4_t v;
+	sF4() { }
+	sF4(float32x4_t v) : v(v) { }
+	sF4(float f) : v(vdupq_n_f32(f)) { }
+	sF4(float a, float b, float c, float d) { const float f[4] = { a, b, c, d }; v = vld1q_f32(f); }
+	sF4 operator+(const sF4& o) const { return vaddq_f32(v, o.v); }
+	sF4 operator-(const sF4& o) const { return vsubq_f32(v, o.v); }
+	sF4 operator*(const sF4& o) const { return vmulq_f32(v, o.v); }
+	void Store(float* Out) const { vst1q_f32(Out, v); }
+	static sF4 Load(const float* In) { return vld1q_f32(In); }
+	static sF4 Max(const sF4& a, const sF4& b) { return vmaxq_f32(a.v, b.v); }
+	static sF4 Min(const sF4& a, const sF4& b) { return vminq_f32(a.v, b.v); }
+	static sF4 Abs(const sF4& a) { return vabsq_f32(a.v); }
+	static sF4 Floor(const sF4& a) { float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(a.v)); return vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(t, a.v), vreinterpretq_u32_f32(vdupq_n_f32(1.f))))); }
+	static sF4 Greater(const sF4& a, const sF4& b) { return vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(a.v, b.v), vreinterpretq_u32_f32(vdupq_n_f32(1.f)))); }
+};
+#else
+struct sF4
+{
+	float v[4];
+	sF4() { }
+	sF4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+	sF4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+	#define F4_OP(EXPR) sF4 r; for (int i = 0; i < 4; i++) r.v[i] = (EXPR); return r;
+	sF4 operator+(const sF4& o) const { F4_OP(v[i] + o.v[i]) }
+	sF4 operator-(const sF4& o) const { F4_OP(v[i] - o.v[i]) }
+	sF4 operator*(const sF4& o) const { F4_OP(v[i] * o.v[i]) }
+	void Store(float* Out) const { for (int i = 0; i < 4; i++) Out[i] = v[i]; }
+	static sF4 Load(const float* In) { return sF4(In[0], In[1], In[2], In[3]); }
+	static sF4 Max(const sF4& a, const sF4& b) { F4_OP(a.v[i] > b.v[i] ? a.v[i] : b.v[i]) }
+	static sF4 Min(const sF4& a, const sF4& b) { F4_OP(a.v[i] < b.v[i] ? a.v[i] : b.v[i]) }
+	static sF4 Abs(const sF4& a) { F4_OP(fabsf(a.v[i])) }
+	static sF4 Floor(const sF4& a) { F4_OP(floorf(a.v[i])) }
+	static sF4 Greater(const sF4& a, const sF4& b) { F4_OP(a.v[i] > b.v[i] ? 1.f : 0.f) }
+	#undef F4_OP
+};
+#endif
+
+//2D simplex noise with the same math as the GLSL snoise (Ashima Arts / Stefan Gustavson), result in [-1,1]
+struct sSimplexNoise
+{
+	static sF4 Mod289(const sF4& x) { return x - sF4::Floor(x * sF4(1.f/289.f)) * sF4(289.f); }
+	static sF4 Permute(const sF4& x) { return Mod289((x * sF4(34.f) + sF4(1.f)) * x); }
+
+	static sF4 Noise4(const sF4& vx, const sF4& vy)
+	{
+		const sF4 Cx(0.211324865405187f), Cy(0.366025403784439f), Cz(-0.577350269189626f), One(1.f), Zero(0.f), Half(.5f);
+		const sF4 s = (vx + vy) * Cy;
+		sF4 ix = sF4::Floor(vx + s), iy = sF4::Floor(vy + s);
+		const sF4 t = (ix + iy) * Cx;
+		const sF4 x0x = vx - ix + t, x0y = vy - iy + t;
+		const sF4 i1x = sF4::Greater(x0x, x0y), i1y = One - i1x;
+		const sF4 x1x = x0x + Cx - i1x, x1y = x0y + Cx - i1y;
+		const sF4 x2x = x0x + Cz, x2y = x0y + Cz;
+		ix = Mod289(ix); iy = Mod289(iy);
+		const sF4 p0 = Permute(Permute(iy) + ix);
+		const sF4 p1 = Permute(Permute(iy + i1y) + ix + i1x);
+		const sF4 p2 = Permute(Permute(iy + One) + ix + One);
+		sF4 m0 = sF4::Max(Half - (x0x*x0x + x0y*x0y), Zero), m1 = sF4::Max(Half - (x1x*x1x + x1y*x1y), Zero), m2 = sF4::Max(Half - (x2x*x2x + x2y*x2y), Zero);
+		m0 = m0*m0; m0 = m0*m0; m1 = m1*m1; m1 = m1*m1; m2 = m2*m2; m2 = m2*m2;
+		return (Corner(m0, p0, x0x, x0y) + Corner(m1, p1, x1x, x1y) + Corner(m2, p2, x2x, x2y)) * sF4(130.f);
+	}
+
+	static sF4 Corner(const sF4& m, const sF4& p, const sF4& x, const sF4& y)
+	{
+		const sF4 gx = (p * sF4(0.024390243902439f)), fx = (gx - sF4::Floor(gx)) * sF4(2.f) - sF4(1.f);
+		const sF4 h = sF4::Abs(fx) - sF4(.5f), a0 = fx - sF4::Floor(fx + sF4(.5f));
+		return m * (sF4(1.79284291400159f) - sF4(0.85373472095314f) * (a0*a0 + h*h)) * (a0 * x + h * y);
+	}
+};
+
+//Parameters of the planet material (same as the uniforms cola,colb,colw,colc,facs,facw,facc)
+struct sPlanetLook
+{
+	float ColA[3], ColB[3], ColW[3], ColC[3];
+	float FacS, FacW, FacC;
+};
+
+enum { PLANETBAKE_WIDTH = 512, PLANETBAKE_HEIGHT = 256 };
+
+//Renders rows [RowFirst, RowEnd) of a PLANETBAKE_WIDTH x PLANETBAKE_HEIGHT RGBA texture
+//The darkening noise d is left out, rgb*(1-d*alpha) gives the colour with it
+static void BakePlanetRows(const sPlanetLook& Look, unsigned char* Pixels, int RowFirst, int RowEnd)
+{
+	const sF4 Zero(0.f), One(1.f), Half(.5f);
+	float Col[3][4], Lum[4], Dark[4];
+	for (int y = RowFirst; y < RowEnd; y++)
+	{
+		const sF4 v((y + .5f) / PLANETBAKE_HEIGHT);
+		unsigned char* Out = Pixels + y * PLANETBAKE_WIDTH * 4;
+		for (int x = 0; x < PLANETBAKE_WIDTH; x += 4, Out += 16)
+		{
+			const float u0 = (x + .5f) / PLANETBAKE_WIDTH, du = 1.f / PLANETBAKE_WIDTH;
+			const sF4 u(u0, u0 + du, u0 + du*2, u0 + du*3);
+			const sF4 FacS(Look.FacS), FacW(Look.FacW), FacC(Look.FacC);
+			const sF4 s = sF4::Min(sF4::Max((sSimplexNoise::Noise4((u+FacS)*FacS, (v+FacS)*FacS) - Half), Zero), One);
+			const sF4 w = sF4::Min(sF4::Max((sSimplexNoise::Noise4((u+FacW)*FacW, (v+FacW)*FacW) - Half) * sF4(3.f), Zero), One);
+			const sF4 c = sF4::Min(sF4::Max((sSimplexNoise::Noise4((u+FacC)*FacC, (v+FacC)*FacC) - Half) * sF4(2.f), Zero), One);
+			const sF4 Keep = (One - w) * (One - c); //share of the base colour that is left after water and clouds
+			sF4 LumAll(0.f), LumDark(0.f);
+			for (int i = 0; i < 3; i++)
+			{
+				//mix(mix(mix(mix(cola,colb,s),0,d),colw,w),colc,c) with d = 0
+				const sF4 a(Look.ColA[i]), b(Look.ColB[i]), cw(Look.ColW[i]), cc(Look.ColC[i]), LumWeight(i == 0 ? .299f : (i == 1 ? .587f : .114f));
+				const sF4 Base = a + (b - a) * s;
+				sF4 r = Base + (cw - Base) * w;
+				r = r + (cc - r) * c;
+				r = sF4::Min(sF4::Max(r, Zero), One);
+				LumAll = LumAll + r * LumWeight;
+				LumDark = LumDark + Base * Keep * LumWeight;
+				(r * sF4(255.f) + Half).Store(Col[i]);
+			}
+			LumAll.Store(Lum);
+			LumDark.Store(Dark);
+			for (int i = 0; i < 4; i++)
+			{
+				Out[i*4+0] = (unsigned char)Col[0][i];
+				Out[i*4+1] = (unsigned char)Col[1][i];
+				Out[i*4+2] = (unsigned char)Col[2][i];
+				const float Weight = (Lum[i] > 1.e-4f ? Dark[i] / Lum[i] : 1.f);
+				Out[i*4+3] = (unsigned char)((Weight < 1.f ? Weight : 1.f) * 255.f + .5f);
+			}
+		}
+	}
+}
+
+enum { TEXTUREBAKE_ROWSPERJOB = 16 };
+
+//A texture being rendered in blocks of rows by the job system, Pixels can be uploaded once IsDone returns true
+struct sTextureBake
+{
+	int Width, Height;
+	std::vector<unsigned char> Pixels; //RGBA
+	std::atomic<int> JobsLeft;
+
+	virtual ~sTextureBake() { }
+	virtual void BakeRows(int RowFirst, int RowEnd) = 0;
+	bool IsDone() const { return JobsLeft.load() == 0; }
+
+protected:
+	sTextureBake(int Width, int Height) : Width(Width), Height(Height), Pixels(Width * Height * 4), JobsLeft(0) { }
+
+	//Must be called by the derived constructor once everything used by BakeRows is set up
+	void Start()
+	{
+		const int Count = (Height + TEXTUREBAKE_ROWSPERJOB - 1) / TEXTUREBAKE_ROWSPERJOB;
+		JobsLeft = Count;
+		Jobs.Add(Job, this, Count);
+	}
+
+	static void Job(void* Data, int Index)
+	{
+		sTextureBake* Bake = (sTextureBake*)Data;
+		const int RowFirst = Index * TEXTUREBAKE_ROWSPERJOB, RowEnd = RowFirst + TEXTUREBAKE_ROWSPERJOB;
+		Bake->BakeRows(RowFirst, (RowEnd < Bake->Height ? RowEnd : Bake->Height));
+		Bake->JobsLeft--;
+	}
+};
+
+struct sPlanetBake : public sTextureBake
+{
+	sPlanetLook Look;
+	sPlanetBake(const sPlanetLook& Look) : sTextureBake(PLANETBAKE_WIDTH, PLANETBAKE_HEIGHT), Look(Look) { Start(); }
+	virtual void BakeRows(int RowFirst, int RowEnd) { BakePlanetRows(Look, &Pixels[0], RowFirst, RowEnd); }
+};
+
+#endif //_COSMICINFLUX_PLANETBAKE_
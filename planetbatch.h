@@ -0,0 +1,168 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_PLANETBATCH_
+#define _COSMICINFLUX_PLANETBATCH_
+
+// Small on-screen planets are merged into pre-transformed meshes of up to PLANETBATCH_SLOTS spheres and drawn with one draw each.
+// The slot is added to the u texture coordinate (u + slot*2) and selects the planet look in a small data texture.
+
+#include <ZL_Display3D.h>
+#include <ZL_Surface.h>
+#include "planetbake.h"
+#include <vector>
+#include <string.h>
+
+#define PLANETBATCH_SLOTS 64 //a define so the batch shader in main.cpp can stringize it
+#define PLANETBATCH_STRINGIZE_(x) #x
+#define PLANETBATCH_STRINGIZE(x) PLANETBATCH_STRINGIZE_(x)
+
+struct sSphereVertex { float Pos[3], Normal[3], Tex[2]; };
+
+//Unit UV sphere, all planet meshes are built from this so a planet looks the same in and out of a batch
+struct sSphereGeometry
+{
+	std::vector<sSphereVertex> Vertices;
+	std::vector<unsigned short> Indices;
+
+	void Build(int Segments)
+	{
+		const int Rings = (Segments + 1) / 2;
+		Vertices.clear();
+		Indices.clear();
+		for (int r = 0; r <= Rings; r++)
+		{
+			const float v = (float)r / Rings, Phi = v * PI, RingRadius = ssin(Phi), RingZ = scos(Phi);
+			for (int s = 0; s <= Segments; s++)
+			{
+				const float u = (float)s / Segments, Theta = u * PI2;
+				const sSphereVertex Vertex = { { RingRadius * scos(Theta), RingRadius * ssin(Theta), RingZ }, { RingRadius * scos(Theta), RingRadius * ssin(Theta), RingZ }, { u, v } };
+				Vertices.push_back(Vertex);
+			}
+		}
+		for (int r = 0; r < Rings; r++)
+			for (int s = 0; s < Segments; s++)
+			{
+				const unsigned short a = (unsigned short)(r * (Segments + 1) + s), b = (unsigned short)(a + Segments + 1);
+				const unsigned short Quad[6] = { a, b, (unsigned short)(a + 1), (unsigned short)(a + 1), b, (unsigned short)(b + 1) };
+				Indices.insert(Indices.end(), Quad, Quad + 6);
+			}
+	}
+
+	ZL_Mesh MakeMesh(const ZL_Material& Material) const
+	{
+		return ZL_Mesh::Make(ZL_MESH_NORMALS | ZL_MESH_TEXCOORDS, &Indices[0], (int)Indices.size(), &Vertices[0], (int)Vertices.size(), Material);
+	}
+};
+
+struct sPlanetBatch
+{
+	std::vector<sSphereVertex> Vertices;
+	std::vector<unsigned short> Indices;
+	unsigned char Data[4][PLANETBATCH_SLOTS][4]; //rows: cola+fade, colb+facs, colw+facw, facc
+	int Count;
+	bool DataDirty;
+	ZL_Mesh Mesh;
+	ZL_Material Mat;
+	ZL_Surface srfData;
+
+	sPlanetBatch() : Count(0), DataDirty(false) { }
+
+	void Begin()
+	{
+		Vertices.clear();
+		Indices.clear();
+		memset(Data, 0, sizeof(Data));
+		Count = 0;
+	}
+
+	bool IsFull() const { return Count == PLANETBATCH_SLOTS; }
+
+	//Adds a planet and returns its slot, Look needs to be quantized with QuantizeLook
+	int Add(const sSphereGeometry& Sphere, const ZL_Matrix& Mtx, const sPlanetLook& Look, float Fade)
+	{
+		const int Slot = Count++;
+		const unsigned short Base = (unsigned short)Vertices.size();
+		for (std::vector<sSphereVertex>::const_iterator it = Sphere.Vertices.begin(); it != Sphere.Vertices.end(); ++it)
+		{
+			const ZL_Vector3 Pos = Mtx.TransformPosition(ZL_Vector3(it->Pos[0], it->Pos[1], it->Pos[2]));
+			const ZL_Vector3 Normal = Mtx.TransformDirection(ZL_Vector3(it->Normal[0], it->Normal[1], it->Normal[2])).VecNorm();
+			const sSphereVertex v = { { Pos.x, Pos.y, Pos.z }, { Normal.x, Normal.y, Normal.z }, { it->Tex[0] + Slot * 2, it->Tex[1] } };
+			Vertices.push_back(v);
+		}
+		for (std::vector<unsigned short>::const_iterator it = Sphere.Indices.begin(); it != Sphere.Indices.end(); ++it)
+			Indices.push_back((unsigned short)(Base + *it));
+		for (int i = 0; i < 3; i++)
+		{
+			Data[0][Slot][i] = ToByte(Look.ColA[i]);
+			Data[1][Slot][i] = ToByte(Look.ColB[i]);
+			Data[2][Slot][i] = ToByte(Look.ColW[i]);
+		}
+		Data[1][Slot][3] = (unsigned char)(Look.FacS * 4.f + .5f);
+		Data[2][Slot][3] = (unsigned char)(Look.FacW * 4.f + .5f);
+		Data[3][Slot][0] = (unsigned char)(Look.FacC * 4.f + .5f);
+		SetFade(Slot, Fade);
+		return Slot;
+	}
+
+	void SetFade(int Slot, float Fade)
+	{
+		const unsigned char f = ToByte(Fade);
+		if (Data[0][Slot][3] == f) return;
+		Data[0][Slot][3] = f;
+		DataDirty = true;
+	}
+
+	//Builds the merged mesh, Material is the batch material to make an instance of
+	void End(const ZL_Material& Material)
+	{
+		if (!Mat) Mat = Material.MakeNewMaterialInstance();
+		Mesh = (Count ? ZL_Mesh::Make(ZL_MESH_NORMALS | ZL_MESH_TEXCOORDS, &Indices[0], (int)Indices.size(), &Vertices[0], (int)Vertices.size(), Mat) : ZL_Mesh());
+		DataDirty = true;
+	}
+
+	//Creates the data texture again if a slot changed since the last call
+	void Update()
+	{
+		if (!DataDirty || !Count) return;
+		srfData = ZL_Surface(&Data[0][0][0], PLANETBATCH_SLOTS, 4, 4).SetTextureFilterMode(false, false);
+		Mat.SetDiffuseTexture(srfData);
+		DataDirty = false;
+	}
+
+	static unsigned char ToByte(float f) { return (unsigned char)((f < 0 ? 0 : (f > 1 ? 1 : f)) * 255.f + .5f); }
+
+	//Rounds a look to what the data texture can store (colors in 1/255, noise factors in 1/4 up to 63.75)
+	static void QuantizeLook(sPlanetLook& Look)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			Look.ColA[i] = ToByte(Look.ColA[i]) / 255.f;
+			Look.ColB[i] = ToByte(Look.ColB[i]) / 255.f;
+			Look.ColW[i] = ToByte(Look.ColW[i]) / 255.f;
+		}
+		Look.FacS = (int)(Look.FacS * 4.f + .5f) / 4.f;
+		Look.FacW = (int)(Look.FacW * 4.f + .5f) / 4.f;
+		Look.FacC = (int)(Look.FacC * 4.f + .5f) / 4.f;
+	}
+};
+
+#endif //_COSMICINFLUX_PLANETBATCH_
@@ -0,0 +1,176 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_PROFILER_
+#define _COSMICINFLUX_PROFILER_
+
+// Frame profiler with CPU timing zones written to profile.csv on exit, and startup stages printed after the first frame.
+// Only compiled in with COSMIC_PROFILER (on by default for ZILLALOG debug builds), otherwise all macros are empty.
+
+#if defined(ZILLALOG) && !defined(COSMIC_PROFILER)
+#define COSMIC_PROFILER
+#endif
+
+enum eProfileZone { PROFZONE_BAKES, PROFZONE_SIM, PROFZONE_PICKING, PROFZONE_RENDERLIST, PROFZONE_DRAW3D, PROFZONE_PARTICLES, PROFZONE_HUD, PROFZONE_MENUS, PROFZONE_FADE, PROFZONE_FRAME, PROFZONE_COUNT };
+
+#ifdef COSMIC_PROFILER
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+static const char* ProfileZoneNames[PROFZONE_COUNT] = { "Bakes", "Simulation", "Picking", "RenderList", "Draw3D", "Particles", "HUD", "Menus", "Fade", "Frame" };
+
+static struct sProfiler
+{
+	typedef std::chrono::steady_clock Clock;
+	enum { HISTORY = 1024, PERCENTILE_FRAMES = 300 }; //HISTORY must be a power of two
+	struct sFrame { float ZoneMS[PROFZONE_COUNT]; };
+	struct sStartupStage { const char* Name; float MS; };
+
+	//single writer ring buffer, other threads may read frames older than FrameCount without locking
+	sFrame History[HISTORY];
+	std::atomic<unsigned int> FrameCount;
+
+	sFrame Current;
+	int Phase;
+	Clock::time_point PhaseStart, FrameStart;
+	bool ShowOverlay;
+	float P50[PROFZONE_COUNT], P99[PROFZONE_COUNT];
+	std::vector<sStartupStage> StartupStages;
+	Clock::time_point ProcessStart, StageStart;
+
+	sProfiler() : FrameCount(0), Phase(-1), FrameStart(Clock::now()), ShowOverlay(false), ProcessStart(FrameStart), StageStart(FrameStart)
+	{
+		memset(&Current, 0, sizeof(Current));
+		memset(P50, 0, sizeof(P50));
+		memset(P99, 0, sizeof(P99));
+	}
+
+	~sProfiler() { if (FrameCount) WriteCSV("profile.csv"); }
+
+	static float MSSince(Clock::time_point Start) { return std::chrono::duration<float, std::milli>(Clock::now() - Start).count(); }
+
+	//Ends the startup stage Name which began at the previous call (or at process start)
+	void StartupStage(const char* Name)
+	{
+		sStartupStage Stage = { Name, MSSince(StageStart) };
+		StartupStages.push_back(Stage);
+		StageStart = Clock::now();
+	}
+
+	void PrintStartup()
+	{
+		printf("Startup:");
+		for (size_t i = 0; i < StartupStages.size(); i++) printf(" %s %.1fms -", StartupStages[i].Name, StartupStages[i].MS);
+		printf(" Time to first frame %.1fms\n", MSSince(ProcessStart));
+	}
+
+	void BeginPhase(int Zone)
+	{
+		const Clock::time_point Now = Clock::now();
+		if (Phase >= 0) Current.ZoneMS[Phase] += std::chrono::duration<float, std::milli>(Now - PhaseStart).count();
+		Phase = Zone;
+		PhaseStart = Now;
+	}
+
+	void EndFrame()
+	{
+		BeginPhase(-1);
+		Current.ZoneMS[PROFZONE_FRAME] = MSSince(FrameStart);
+		FrameStart = Clock::now();
+		const unsigned int Frame = FrameCount.load(std::memory_order_relaxed);
+		if (!Frame) { StartupStage("FirstFrame"); PrintStartup(); }
+		History[Frame & (HISTORY - 1)] = Current;
+		FrameCount.store(Frame + 1, std::memory_order_release);
+		memset(&Current, 0, sizeof(Current));
+		if (ShowOverlay && (Frame % 30) == 0) CalcPercentiles();
+	}
+
+	void CalcPercentiles()
+	{
+		const unsigned int End = FrameCount, Count = (End < PERCENTILE_FRAMES ? End : (unsigned int)PERCENTILE_FRAMES);
+		if (!Count) return;
+		float Values[PERCENTILE_FRAMES];
+		for (int z = 0; z < PROFZONE_COUNT; z++)
+		{
+			for (unsigned int i = 0; i < Count; i++) Values[i] = History[(End - 1 - i) & (HISTORY - 1)].ZoneMS[z];
+			std::nth_element(Values, Values + Count / 2, Values + Count);
+			P50[z] = Values[Count / 2];
+			std::nth_element(Values, Values + Count * 99 / 100, Values + Count);
+			P99[z] = Values[Count * 99 / 100];
+		}
+	}
+
+	void WriteCSV(const char* Path)
+	{
+		FILE* f = fopen(Path, "w");
+		if (!f) return;
+		fprintf(f, "frame");
+		for (int z = 0; z < PROFZONE_COUNT; z++) fprintf(f, ",%s", ProfileZoneNames[z]);
+		fprintf(f, "\n");
+		const unsigned int End = FrameCount, First = (End > HISTORY ? End - HISTORY : 0);
+		for (unsigned int i = First; i < End; i++)
+		{
+			fprintf(f, "%u", i);
+			for (int z = 0; z < PROFZONE_COUNT; z++) fprintf(f, ",%.4f", History[i & (HISTORY - 1)].ZoneMS[z]);
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+} Profiler;
+
+struct sProfileScope
+{
+	int Zone;
+	sProfiler::Clock::time_point Start;
+	sProfileScope(int Zone) : Zone(Zone), Start(sProfiler::Clock::now()) { }
+	~sProfileScope() { Profiler.Current.ZoneMS[Zone] += sProfiler::MSSince(Start); }
+};
+
+struct sProfileTimer
+{
+	float& MS;
+	sProfiler::Clock::time_point Start;
+	sProfileTimer(float& MS) : MS(MS), Start(sProfiler::Clock::now()) { }
+	~sProfileTimer() { MS += sProfiler::MSSince(Start); }
+};
+
+#define PROFILE_SCOPE_NAME2(Line) ProfileScope##Line
+#define PROFILE_SCOPE_NAME(Line) PROFILE_SCOPE_NAME2(Line)
+#define PROFILE_SCOPE(Zone) sProfileScope PROFILE_SCOPE_NAME(__LINE__)(Zone)
+#define PROFILE_PHASE(Zone) Profiler.BeginPhase(Zone)
+#define PROFILE_TIME_INTO(MSVar) sProfileTimer PROFILE_SCOPE_NAME(__LINE__)(MSVar)
+#define PROFILE_ADD(Zone, MS) (Profiler.Current.ZoneMS[Zone] += (MS))
+#define PROFILE_END_FRAME() Profiler.EndFrame()
+#define PROFILE_STARTUP_STAGE(Name) Profiler.StartupStage(Name)
+#else
+#define PROFILE_SCOPE(Zone)
+#define PROFILE_PHASE(Zone)
+#define PROFILE_TIME_INTO(MSVar)
+#define PROFILE_ADD(Zone, MS)
+#define PROFILE_END_FRAME()
+#define PROFILE_STARTUP_STAGE(Name)
+#endif
+
+#endif //_COSMICINFLUX_PROFILER_
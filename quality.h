@@ -0,0 +1,175 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_QUALITY_
+#define _COSMICINFLUX_QUALITY_
+
+// Quality governor that steps through the tiers below to hold the display refresh rate measured from the frame intervals.
+// Any setting can be pinned with a "key value" line in the quality file (see QualityKeys), pinning the tier turns the governor off.
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+struct sQualitySettings
+{
+	bool AA;
+	float PlanetDetail; //scales the projected planet radius used to select the mesh lod
+	int NoiseDetail;    //1 renders the fine detail noise octave of planets, 0 skips it
+	int SkyDetail;      //2 sky and parallax star layers, 1 sky only, 0 black sky
+	int TextShadows;    //shadow passes rendered around cached texts (8, 4 or 0)
+};
+
+enum { QUALITY_TIERS = 6 };
+static const sQualitySettings QualityTiers[QUALITY_TIERS] =
+{
+	{ true,  1.f,  1, 2, 8 },
+	{ false, 1.f,  1, 2, 8 },
+	{ false, .5f,  1, 2, 8 },
+	{ false, .5f,  0, 1, 4 },
+	{ false, .25f, 0, 1, 4 },
+	{ false, .25f, 0, 0, 0 },
+};
+
+enum eQualityKey { QKEY_TIER, QKEY_TARGETFPS, QKEY_AA, QKEY_PLANETDETAIL, QKEY_NOISEDETAIL, QKEY_SKYDETAIL, QKEY_TEXTSHADOWS, QKEY_COUNT };
+static const char* QualityKeys[QKEY_COUNT] = { "tier", "target_fps", "aa", "planet_detail", "noise_detail", "sky_detail", "text_shadows" };
+
+static const float RefreshRates[] = { 30, 48, 50, 60, 72, 75, 90, 100, 120, 144, 165, 240 };
+
+static struct sQualityGovernor
+{
+	enum { REFRESH_WINDOW = 120 };
+	int Tier;
+	float TargetMS;
+	unsigned int Pinned; //bit per eQualityKey
+	sQualitySettings Pins;
+
+	float AvgFrameMS, AvgCpuMS, OverSeconds, GoodSeconds, Cooldown, UpgradeDelay, SinceUpgrade;
+	float RefreshMS; //measured refresh interval, 0 until the first window is done
+	float Intervals[REFRESH_WINDOW];
+	int IntervalCount;
+
+	sQualityGovernor() : Tier(0), TargetMS(1000.f / 60.f), Pinned(0), AvgFrameMS(0), AvgCpuMS(0), OverSeconds(0), GoodSeconds(0), Cooldown(2.f), UpgradeDelay(5.f), SinceUpgrade(1000.f), RefreshMS(0), IntervalCount(0)
+	{
+		Pins = QualityTiers[0];
+	}
+
+	//Interval of the common refresh rate closest to the given frame interval
+	static float SnapRefreshMS(float FrameMS)
+	{
+		const float Hz = 1000.f / (FrameMS > .1f ? FrameMS : .1f);
+		float Best = RefreshRates[0];
+		for (size_t i = 1; i < sizeof(RefreshRates)/sizeof(RefreshRates[0]); i++)
+			if (fabsf(RefreshRates[i] - Hz) < fabsf(Best - Hz)) Best = RefreshRates[i];
+		return 1000.f / Best;
+	}
+
+	void MeasureRefresh(float FrameMS)
+	{
+		Intervals[IntervalCount++] = FrameMS;
+		if (IntervalCount < REFRESH_WINDOW) return;
+		IntervalCount = 0;
+		std::nth_element(Intervals, Intervals + REFRESH_WINDOW / 10, Intervals + REFRESH_WINDOW);
+		const float Measured = SnapRefreshMS(Intervals[REFRESH_WINDOW / 10]);
+		if (RefreshMS && Measured >= RefreshMS) return;
+		RefreshMS = Measured;
+		if (!IsPinned(QKEY_TARGETFPS)) TargetMS = RefreshMS;
+	}
+
+	bool IsPinned(eQualityKey Key) const { return (Pinned & (1u << Key)) != 0; }
+
+	//Parses "key value" lines, unknown keys and bad values are ignored
+	void LoadPins(const char* Text)
+	{
+		char Key[32];
+		float Value;
+		for (const char* Line = Text; Line; Line = strchr(Line, '\n'))
+		{
+			if (*Line == '\n') Line++;
+			if (sscanf(Line, "%31s %f", Key, &Value) != 2) continue;
+			for (int k = 0; k < QKEY_COUNT; k++)
+				if (!strcmp(Key, QualityKeys[k])) Pin((eQualityKey)k, Value);
+		}
+	}
+
+	void Pin(eQualityKey Key, float Value)
+	{
+		switch (Key)
+		{
+			case QKEY_TIER:         if (Value < 0 || Value >= QUALITY_TIERS) return; Tier = (int)Value; break;
+			case QKEY_TARGETFPS:    if (Value < 10) return; TargetMS = 1000.f / Value; break;
+			case QKEY_AA:           Pins.AA = (Value != 0); break;
+			case QKEY_PLANETDETAIL: if (Value <= 0) return; Pins.PlanetDetail = Value; break;
+			case QKEY_NOISEDETAIL:  Pins.NoiseDetail = (Value != 0); break;
+			case QKEY_SKYDETAIL:    Pins.SkyDetail = (Value < 0 ? 0 : Value > 2 ? 2 : (int)Value); break;
+			case QKEY_TEXTSHADOWS:  Pins.TextShadows = (Value >= 8 ? 8 : Value >= 4 ? 4 : 0); break;
+			default: return;
+		}
+		Pinned |= 1u << Key;
+	}
+
+	//The settings of the current tier with the pinned ones replaced
+	sQualitySettings GetSettings() const
+	{
+		sQualitySettings s = QualityTiers[Tier];
+		if (IsPinned(QKEY_AA))           s.AA = Pins.AA;
+		if (IsPinned(QKEY_PLANETDETAIL)) s.PlanetDetail = Pins.PlanetDetail;
+		if (IsPinned(QKEY_NOISEDETAIL))  s.NoiseDetail = Pins.NoiseDetail;
+		if (IsPinned(QKEY_SKYDETAIL))    s.SkyDetail = Pins.SkyDetail;
+		if (IsPinned(QKEY_TEXTSHADOWS))  s.TextShadows = Pins.TextShadows;
+		return s;
+	}
+
+	//Call once per frame with the frame interval and the main thread CPU time, returns true if the tier changed
+	bool Update(float FrameMS, float CpuMS, float Elapsed)
+	{
+		MeasureRefresh(FrameMS);
+		//a single long hitch (loading, window moves) only counts as a slow frame
+		FrameMS = (FrameMS < TargetMS * 4 ? FrameMS : TargetMS * 4);
+		const float Blend = (Elapsed < .5f ? Elapsed / .5f : 1.f);
+		AvgFrameMS += (FrameMS - AvgFrameMS) * Blend;
+		AvgCpuMS += (CpuMS - AvgCpuMS) * Blend;
+		SinceUpgrade += Elapsed;
+		if (IsPinned(QKEY_TIER)) return false;
+		if (Cooldown > 0) { Cooldown -= Elapsed; return false; }
+
+		OverSeconds = (AvgFrameMS > TargetMS * 1.15f ? OverSeconds + Elapsed : 0);
+		GoodSeconds = (AvgFrameMS < TargetMS * 1.05f ? GoodSeconds + Elapsed : 0);
+		if (OverSeconds > 1.f && Tier < QUALITY_TIERS - 1)
+		{
+			if (SinceUpgrade < 10.f) UpgradeDelay = (UpgradeDelay < 40.f ? UpgradeDelay * 2 : 80.f); //a raise taken back shortly after waits longer next time
+			Tier++;
+		}
+		else if (GoodSeconds > UpgradeDelay && Tier > 0)
+		{
+			SinceUpgrade = 0;
+			Tier--;
+		}
+		else return false;
+		OverSeconds = GoodSeconds = 0;
+		Cooldown = 1.f; //let the averages settle on the new tier
+		return true;
+	}
+} Quality;
+
+#endif //_COSMICINFLUX_QUALITY_
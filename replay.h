@@ -0,0 +1,146 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_REPLAY_
+#define _COSMICINFLUX_REPLAY_
+
+// A recording is the galaxy seed plus the player decisions tagged with the fixed simulation step they were made at,
+// enough to reproduce a run exactly in the game or headless.
+
+#include "simulation.h"
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+enum eReplayEventType { REPLAY_SCAN, REPLAY_VISIT, REPLAY_IGNORE, REPLAY_ABORT, REPLAY_CONTINUE, REPLAY_EVENTTYPE_COUNT };
+static const char* ReplayEventNames[REPLAY_EVENTTYPE_COUNT] = { "scan", "visit", "ignore", "abort", "continue" };
+
+struct sReplayEvent
+{
+	unsigned int Step;
+	int Type, Planet;
+};
+
+struct sRecording
+{
+	unsigned int Seed;
+	bool Endless;
+	std::vector<sReplayEvent> Events;
+
+	//outcome of the recorded run to verify a replay against (ResultEvent is SIMEVENT_NONE if the run was abandoned)
+	int ResultEvent;
+	unsigned int ResultSteps;
+	float ResultPower;
+
+	sRecording() : Seed(0), Endless(false), ResultEvent(SIMEVENT_NONE), ResultSteps(0), ResultPower(0) { }
+
+	void Reset(unsigned int NewSeed, bool NewEndless)
+	{
+		Seed = NewSeed;
+		Endless = NewEndless;
+		Events.clear();
+		ResultEvent = SIMEVENT_NONE;
+		ResultSteps = 0;
+		ResultPower = 0;
+	}
+
+	void Add(unsigned int Step, int Type, int Planet)
+	{
+		sReplayEvent e = { Step, Type, Planet };
+		Events.push_back(e);
+	}
+
+	void SetResult(int Event, unsigned int Steps, float Power)
+	{
+		ResultEvent = Event;
+		ResultSteps = Steps;
+		ResultPower = Power;
+	}
+
+	//Text format: header line, result line, one line per event
+	bool Save(const char* Path) const
+	{
+		FILE* f = fopen(Path, "w");
+		if (!f) return false;
+		fprintf(f, "COSMICINFLUX-RECORDING 1 seed %u endless %d\n", Seed, (int)Endless);
+		fprintf(f, "result %d steps %u power %.9g\n", ResultEvent, ResultSteps, ResultPower);
+		for (size_t i = 0; i < Events.size(); i++)
+			fprintf(f, "%u %s %d\n", Events[i].Step, ReplayEventNames[Events[i].Type], Events[i].Planet);
+		return (fclose(f) == 0);
+	}
+
+	bool Load(const char* Path)
+	{
+		FILE* f = fopen(Path, "r");
+		if (!f) return false;
+		int Version = 0, IsEndless = 0;
+		Events.clear();
+		bool Ok = (fscanf(f, " COSMICINFLUX-RECORDING %d seed %u endless %d", &Version, &Seed, &IsEndless) == 3 && Version == 1);
+		Ok = Ok && (fscanf(f, " result %d steps %u power %f", &ResultEvent, &ResultSteps, &ResultPower) == 3);
+		Endless = (IsEndless != 0);
+		char Name[32];
+		sReplayEvent e;
+		while (Ok && fscanf(f, " %u %31s %d", &e.Step, Name, &e.Planet) == 3)
+		{
+			for (e.Type = 0; e.Type < REPLAY_EVENTTYPE_COUNT && strcmp(Name, ReplayEventNames[e.Type]); e.Type++) {}
+			Ok = (e.Type < REPLAY_EVENTTYPE_COUNT && (Events.empty() || e.Step >= Events.back().Step));
+			Events.push_back(e);
+		}
+		fclose(f);
+		return Ok;
+	}
+};
+
+//Plays back a recording without rendering by driving the simulation the same way the game loop does
+static eSimEvent RunRecording(sSimulation& Sim, const sRecording& Rec, unsigned int& Steps, unsigned int MaxSteps = 100000000)
+{
+	Sim.Start(Rec.Seed, Rec.Endless);
+	bool Paused = false;
+	size_t Next = 0;
+	for (Steps = 0; Steps < MaxSteps;)
+	{
+		for (; Next < Rec.Events.size() && Rec.Events[Next].Step == Steps; Next++)
+		{
+			const sReplayEvent& e = Rec.Events[Next];
+			if      (e.Type == REPLAY_SCAN)     Paused = true;
+			else if (e.Type == REPLAY_VISIT)    { Sim.Visit(e.Planet); Paused = false; }
+			else if (e.Type == REPLAY_IGNORE)   Paused = false;
+			else if (e.Type == REPLAY_ABORT)    { Sim.Abort(); Paused = false; }
+			else if (e.Type == REPLAY_CONTINUE) { Sim.Continue(); Paused = false; }
+		}
+		if (Paused) break; //recording ended while a menu was open
+		const eSimEvent Event = Sim.Step(Sim.GetStepMove(SimStepSeconds));
+		Steps++;
+		if (Rec.Endless) Sim.StreamChunks();
+		if (Event == SIMEVENT_WIN || Event == SIMEVENT_LOSE) return Event;
+		if (Event == SIMEVENT_LANDED) Paused = true;
+	}
+	return SIMEVENT_NONE;
+}
+
+//Plays back a recording and compares the outcome with the result stored in it
+static bool VerifyRecording(sSimulation& Sim, const sRecording& Rec, eSimEvent& Event, unsigned int& Steps)
+{
+	Event = RunRecording(Sim, Rec, Steps);
+	return (Event == Rec.ResultEvent && Steps == Rec.ResultSteps && Sim.Power == Rec.ResultPower);
+}
+
+#endif //_COSMICINFLUX_REPLAY_
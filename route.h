@@ -0,0 +1,227 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_ROUTE_
+#define _COSMICINFLUX_ROUTE_
+
+// Expected value route planner, picks non-overlapping visits to the planets ahead by weighted interval scheduling with the power level in the state.
+// Solved in the background by a chain of jobs when planets get added, the travel target changes or a new galaxy starts.
+
+#include "simulation.h"
+#include "jobs.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+enum { ROUTE_SLICE = 256, ROUTE_DEPARTURES = 4, ROUTE_POWER_LEVELS = 21 };
+static const float RouteDepartures[ROUTE_DEPARTURES] = { 3.f, 10.f, 20.f, 35.f }; //distances before a planet to leave the center line (visitable window is 3 to 35)
+
+struct sRouteVisit
+{
+	float Start, End, Gain, Drain; //Drain is the extra drain compared to the center line
+	int Planet;
+	bool operator<(const sRouteVisit& o) const { return Start < o.Start; }
+};
+
+struct sRoutePlan
+{
+	//input snapshot of the planets (Eligible is 0 for the home planet, cleared planets and the current travel target)
+	std::vector<float> Z, X, Y, Radius, Gain;
+	std::vector<unsigned char> Eligible;
+	float DrainFactor, PowerStart;
+	double Origin;
+	int RemovedBase, Generation;
+
+	//candidates sorted by start, Best[k * ROUTE_POWER_LEVELS + l] is the best total expected power change of the
+	//visits from candidate k on when arriving at its start with power level l, row n (no candidates left) is 0
+	std::vector<sRouteVisit> Visits;
+	std::vector<int> Next; //first candidate starting after candidate k ends
+	std::vector<float> Best;
+	std::vector<unsigned char> Take;
+	int Solved; //candidates from the end that have been solved
+
+	//Power level of a power amount, rounded down so a plan never counts on power it might not have
+	int GetLevel(float Power) const
+	{
+		const int l = (int)(Power * (ROUTE_POWER_LEVELS - 1) / PowerStart);
+		return (l < 0 ? 0 : (l >= ROUTE_POWER_LEVELS ? ROUTE_POWER_LEVELS - 1 : l));
+	}
+
+	float GetLevelPower(int Level) const { return PowerStart * Level / (ROUTE_POWER_LEVELS - 1); }
+
+	//Power after visiting candidate k arriving with Power, -1 if the trip can't be made
+	float GetPowerAfter(int k, float Power) const
+	{
+		const sRouteVisit& v = Visits[k];
+		if (v.Drain >= Power) return -1;
+		const float Left = Power - v.Drain;
+		return Left + (v.Gain < PowerStart - Left ? v.Gain : PowerStart - Left);
+	}
+
+	//Best total from candidate j on when reaching its start with Power after flying straight from z From
+	float GetBestFrom(int j, float From, float Power) const
+	{
+		if (j >= (int)Visits.size()) return 0;
+		Power -= Visits[j].Start - From;
+		return (Power > 0 ? Best[j * ROUTE_POWER_LEVELS + GetLevel(Power)] : 0);
+	}
+};
+
+static struct sRouteOptimizer
+{
+	enum { STATE_IDLE, STATE_BUSY, STATE_DONE };
+	sRoutePlan Plans[2];
+	int Front, Generation, Removed, PlannedTotal, PlannedTravel; //number of planets ever added and absolute index of the travel target at the time of the last plan
+	std::atomic<int> State;
+
+	sRouteOptimizer() : Front(0), Generation(0), Removed(0), PlannedTotal(-1), PlannedTravel(-1), State(STATE_IDLE) { }
+
+	//Call when a new galaxy starts
+	void Reset()
+	{
+		Generation++;
+		Removed = 0;
+		PlannedTotal = PlannedTravel = -1;
+		Plans[Front].Visits.clear();
+	}
+
+	//Call when planets were erased from the front of the planet store (endless mode)
+	void OnPlanetsRemoved(int Count) { Removed += Count; }
+
+	bool HasPlan() const { return !Plans[Front].Visits.empty() && Plans[Front].Generation == Generation; }
+
+	//Picks up a finished plan and starts a new one if the galaxy changed since the last one, never blocks
+	void Update(const sSimulation& Sim)
+	{
+		if (State.load(std::memory_order_acquire) == STATE_BUSY) return;
+		if (State == STATE_DONE)
+		{
+			State = STATE_IDLE;
+			if (Plans[1 - Front].Generation == Generation) Front = 1 - Front;
+		}
+		const int Total = Removed + Sim.Planets.Size(), Travel = (Sim.TravelPlanet >= 0 ? Removed + Sim.TravelPlanet : -1);
+		if (Total == PlannedTotal && Travel == PlannedTravel && Plans[Front].Generation == Generation) return;
+		PlannedTotal = Total;
+		PlannedTravel = Travel;
+
+		sRoutePlan& p = Plans[1 - Front];
+		const int n = Sim.Planets.Size();
+		p.Z = Sim.Planets.Z; p.X = Sim.Planets.X; p.Y = Sim.Planets.Y; p.Radius = Sim.Planets.Radius;
+		p.Gain.resize(n);
+		p.Eligible.resize(n);
+		for (int i = 0; i < n; i++)
+		{
+			//a gain/loss happens if chance >= RAND(0,100) and is then uniform in [10,100]
+			const sSimPlanetInfo& Info = Sim.Planets.Info[i];
+			p.Gain[i] = ((Info.ChancePower + 1) - (Info.ChanceEnemy + 1)) / 101.f * 55.f;
+			p.Eligible[i] = (!Info.IsHome && !Info.Cleared && i != Sim.TravelPlanet);
+		}
+		p.DrainFactor = Sim.Params.TravelDrainFactor;
+		p.PowerStart = Sim.Params.PowerStart;
+		p.Origin = Sim.Origin;
+		p.RemovedBase = Removed;
+		p.Generation = Generation;
+		p.Solved = -1;
+		State = STATE_BUSY;
+		Jobs.Add(Job, this);
+	}
+
+	static void Job(void* Data, int)
+	{
+		sRouteOptimizer* r = (sRouteOptimizer*)Data;
+		sRoutePlan& p = r->Plans[1 - r->Front];
+		if (p.Solved < 0) BuildVisits(p);
+		else SolveSlice(p);
+		if (p.Solved < (int)p.Visits.size()) Jobs.Add(Job, r); //continue with the next slice
+		else r->State.store(STATE_DONE, std::memory_order_release);
+	}
+
+	static void BuildVisits(sRoutePlan& p)
+	{
+		p.Visits.clear();
+		for (int i = 0; i < (int)p.Z.size(); i++)
+		{
+			if (!p.Eligible[i]) continue;
+			const sSimVec3 PlanetPos(p.X[i], p.Y[i], p.Z[i]);
+			for (int d = 0; d < ROUTE_DEPARTURES; d++)
+			{
+				const sSimVec3 From(0, 0, p.Z[i] - RouteDepartures[d]);
+				sRouteVisit v = { From.z, p.Z[i] + RouteDepartures[d], p.Gain[i], sSimulation::CalcTravelFrom(From, PlanetPos, p.Radius[i], p.DrainFactor).DrainExtra, i };
+				if (v.Gain > v.Drain && v.Drain < p.PowerStart) p.Visits.push_back(v); //never worth it otherwise
+			}
+		}
+		std::sort(p.Visits.begin(), p.Visits.end());
+		const int n = (int)p.Visits.size();
+		p.Next.resize(n);
+		p.Best.assign((n + 1) * ROUTE_POWER_LEVELS, 0.f);
+		p.Take.assign(n * ROUTE_POWER_LEVELS, 0);
+		for (int k = 0; k < n; k++)
+		{
+			const sRouteVisit Key = { p.Visits[k].End, 0, 0, 0, 0 };
+			p.Next[k] = (int)(std::lower_bound(p.Visits.begin() + k, p.Visits.end(), Key) - p.Visits.begin());
+		}
+		p.Solved = 0;
+	}
+
+	static void SolveSlice(sRoutePlan& p)
+	{
+		const int n = (int)p.Visits.size();
+		for (int Count = 0; Count < ROUTE_SLICE && p.Solved < n; Count++, p.Solved++)
+		{
+			const int k = n - 1 - p.Solved;
+			const float Start = p.Visits[k].Start;
+			for (int l = 0; l < ROUTE_POWER_LEVELS; l++)
+			{
+				const float Power = p.GetLevelPower(l), After = p.GetPowerAfter(k, Power);
+				const float Without = p.GetBestFrom(k + 1, Start, Power);
+				const float With = (After < 0 ? -1.f : After - Power + p.GetBestFrom(p.Next[k], Start, After));
+				const int i = k * ROUTE_POWER_LEVELS + l;
+				p.Take[i] = (With > Without);
+				p.Best[i] = (p.Take[i] ? With : Without);
+			}
+		}
+	}
+
+	//Writes the current indices of up to MaxCount planets suggested to visit next, in order, for the current power and position
+	int GetNextVisits(const sSimulation& Sim, int* Out, int MaxCount) const
+	{
+		if (!HasPlan()) return 0;
+		const sRoutePlan& p = Plans[Front];
+		const sRouteVisit Key = { Sim.Pos.z + (float)(Sim.Origin - p.Origin), 0, 0, 0, 0 };
+		const int n = (int)p.Visits.size(), Shift = Removed - p.RemovedBase;
+		float Z = Key.Start, Power = Sim.Power;
+		int Count = 0;
+		for (int k = (int)(std::lower_bound(p.Visits.begin(), p.Visits.end(), Key) - p.Visits.begin()); k < n && Count < MaxCount;)
+		{
+			Power -= p.Visits[k].Start - Z; //straight flight up to the candidate
+			Z = p.Visits[k].Start;
+			if (Power <= 0) break;
+			if (!p.Take[k * ROUTE_POWER_LEVELS + p.GetLevel(Power)]) { k++; continue; }
+			const int Planet = p.Visits[k].Planet - Shift;
+			if (Planet >= 0 && Planet < Sim.Planets.Size() && !Sim.Planets.Info[Planet].Cleared) Out[Count++] = Planet;
+			Power = p.GetPowerAfter(k, Power);
+			k = p.Next[k];
+		}
+		return Count;
+	}
+} Route;
+
+#endif //_COSMICINFLUX_ROUTE_
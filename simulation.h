@@ -0,0 +1,339 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_SIMULATION_
+#define _COSMICINFLUX_SIMULATION_
+
+// Renderer-free game simulation. Has no ZillaLib dependency so it can be shared
+// between the game (main.cpp) and the headless tools in the Tools directory.
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+static const float PowerStart = 100.f;
+static const float GoalDistance = 150.f;
+static const float TravelDrainFactor = 4.f;
+static const float SimSmallNumber = 1.e-4f;
+static const float EndlessChunkLength = 32.f;
+static const float EndlessRebaseDistance = 1024.f;
+static const float SimStepSeconds = 1.f / 60.f; //fixed time step of the game loop
+
+struct sSimRand
+{
+	unsigned int State;
+	sSimRand(unsigned int Seed = 0) { SetSeed(Seed); }
+	void SetSeed(unsigned int Seed) { State = Seed * 2654435761u + 0x9E3779B9u; if (!State) State = 1; UInt(); }
+	unsigned int UInt() { State ^= State << 13; State ^= State >> 17; State ^= State << 5; return State; }
+	int Int(int Min, int Max) { return Min + (int)(UInt() % (unsigned int)(Max - Min + 1)); } //inclusive Max like RAND_INT_RANGE
+	float Float() { return (UInt() >> 8) * (1.f / 16777216.f); }
+	float Range(float Min, float Max) { return Min + (Max - Min) * Float(); }
+	float Sign() { return ((UInt() & 0x100) ? 1.f : -1.f); }
+};
+
+struct sSimVec3
+{
+	float x, y, z;
+	sSimVec3() { }
+	sSimVec3(float x, float y, float z) : x(x), y(y), z(z) { }
+	sSimVec3 operator+(const sSimVec3& o) const { return sSimVec3(x + o.x, y + o.y, z + o.z); }
+	sSimVec3 operator-(const sSimVec3& o) const { return sSimVec3(x - o.x, y - o.y, z - o.z); }
+	sSimVec3 operator*(float f) const { return sSimVec3(x * f, y * f, z * f); }
+	float GetLength() const { return sqrtf(x*x + y*y + z*z); }
+};
+
+struct sSimParams
+{
+	float PowerStart, GoalDistance, TravelDrainFactor;
+	sSimParams() : PowerStart(::PowerStart), GoalDistance(::GoalDistance), TravelDrainFactor(::TravelDrainFactor) { }
+};
+
+//Gameplay values of a planet only needed when scanning or landing
+struct sSimPlanetInfo
+{
+	int ChancePower, ChanceEnemy;
+	int GainByPower, LoseByEnemy;
+	bool IsHome, Cleared;
+};
+
+//Structure of arrays planet store, z positions are contiguous and sorted ascending
+struct sPlanetStore
+{
+	std::vector<float> Z;
+	std::vector<float> X, Y, Radius;
+	std::vector<sSimPlanetInfo> Info;
+
+	int Size() const { return (int)Z.size(); }
+	sSimVec3 GetPos(int i) const { return sSimVec3(X[i], Y[i], Z[i]); }
+	void Clear() { Z.clear(); X.clear(); Y.clear(); Radius.clear(); Info.clear(); }
+	void EraseFront(int n) { Z.erase(Z.begin(), Z.begin()+n); X.erase(X.begin(), X.begin()+n); Y.erase(Y.begin(), Y.begin()+n); Radius.erase(Radius.begin(), Radius.begin()+n); Info.erase(Info.begin(), Info.begin()+n); }
+	void Reserve(size_t n) { Z.reserve(n); X.reserve(n); Y.reserve(n); Radius.reserve(n); Info.reserve(n); }
+
+	//planets need to be added with increasing z
+	void Add(const sSimVec3& Pos, float PlanetRadius, const sSimPlanetInfo& PlanetInfo)
+	{
+		Z.push_back(Pos.z); X.push_back(Pos.x); Y.push_back(Pos.y); Radius.push_back(PlanetRadius); Info.push_back(PlanetInfo);
+	}
+
+	//Index range [First, End) of planets with z in [Z0, Z1]
+	void Range(float Z0, float Z1, int& First, int& End) const
+	{
+		First = (int)(std::lower_bound(Z.begin(), Z.end(), Z0) - Z.begin());
+		End = (int)(std::upper_bound(Z.begin() + First, Z.end(), Z1) - Z.begin());
+	}
+};
+
+struct sSimTravel
+{
+	sSimVec3 Dir;
+	float Distance, DrainExtra;
+};
+
+enum eSimEvent { SIMEVENT_NONE, SIMEVENT_LANDED, SIMEVENT_WIN, SIMEVENT_LOSE };
+
+struct sSimulation
+{
+	sSimParams Params;
+	sPlanetStore Planets;
+	sSimVec3 Pos, Dir;
+	float Distance, Power;
+	int TravelPlanet, LandedPlanet, LastTravelPlanet; //planet indices, -1 if none
+
+	//Endless mode streams the galaxy in chunks of EndlessChunkLength generated from a per-chunk seed.
+	//Positions stay relative to Origin which gets moved forward every EndlessRebaseDistance to keep float precision.
+	bool Endless;
+	unsigned int Seed;
+	double Origin;
+	int ChunkFirst, ChunkNext;
+	std::vector<int> ChunkPlanetCounts;
+
+	sSimulation() : Endless(false), Seed(0), Origin(0), ChunkFirst(0), ChunkNext(0) { }
+
+	//Generates a new galaxy with the same distribution the game always used and resets the player to the start
+	void Start(unsigned int NewSeed, bool NewEndless = false)
+	{
+		Seed = NewSeed;
+		Endless = NewEndless;
+		Origin = 0;
+		Pos = sSimVec3(0, 0, 0);
+		Power = Params.PowerStart;
+		TravelPlanet = LandedPlanet = LastTravelPlanet = -1;
+		AdvanceToGoal(false);
+
+		Planets.Clear();
+		if (Endless)
+		{
+			ChunkFirst = ChunkNext = 0;
+			ChunkPlanetCounts.clear();
+			StreamChunks();
+			return;
+		}
+
+		sSimRand Rand(Seed);
+		for (float i = 0; i < Params.GoalDistance - 7.f; i += Rand.Range(1,10))
+			AddRandomPlanet(Rand, i);
+		sSimPlanetInfo Home;
+		Home.ChancePower = Home.ChanceEnemy = Home.GainByPower = Home.LoseByEnemy = 0;
+		Home.IsHome = true;
+		Home.Cleared = false;
+		Planets.Add(sSimVec3(0, -1.f, Params.GoalDistance + 4.f), 1.f, Home);
+	}
+
+	void AddRandomPlanet(sSimRand& Rand, float z)
+	{
+		sSimPlanetInfo p;
+		p.ChancePower = Rand.Int(0, 10)*10;
+		p.ChanceEnemy = Rand.Int(0, 10)*10;
+		p.GainByPower = (p.ChancePower < Rand.Int(0,100) ? 0 : Rand.Int(10,100));
+		p.LoseByEnemy = (p.ChanceEnemy < Rand.Int(0,100) ? 0 : Rand.Int(10,100));
+		p.IsHome = false;
+		p.Cleared = false;
+		const float Radius = Rand.Range(.25f,1.5f);
+		const float x = Rand.Range(1,4)*Rand.Sign();
+		const float y = Rand.Range(1,4)*Rand.Sign();
+		Planets.Add(sSimVec3(x, y, z), Radius, p);
+	}
+
+	float GetChunkZ(int Chunk) const { return (float)(Chunk * (double)EndlessChunkLength - Origin); }
+
+	//Endless mode: generates chunks up to one chunk beyond the visibility window and drops chunks behind the camera.
+	//Returns the number of planets removed from the front of the store, all planet indices shift down by that amount.
+	int StreamChunks()
+	{
+		int Removed = 0;
+		while (ChunkPlanetCounts.size() > 1 && GetChunkZ(ChunkFirst + 1) < Pos.z - 10.f)
+		{
+			Removed += ChunkPlanetCounts[0];
+			ChunkPlanetCounts.erase(ChunkPlanetCounts.begin());
+			ChunkFirst++;
+		}
+		if (Removed)
+		{
+			Planets.EraseFront(Removed);
+			TravelPlanet = ShiftIndex(TravelPlanet, Removed);
+			LandedPlanet = ShiftIndex(LandedPlanet, Removed);
+			LastTravelPlanet = ShiftIndex(LastTravelPlanet, Removed);
+		}
+
+		while (GetChunkZ(ChunkNext) < Pos.z + 60.f + EndlessChunkLength)
+		{
+			sSimRand Rand(Seed ^ ((unsigned int)ChunkNext * 0x9E3779B9u));
+			const int CountBefore = Planets.Size();
+			const float ChunkZ = GetChunkZ(ChunkNext), ChunkEnd = GetChunkZ(ChunkNext + 1);
+			for (float i = ChunkZ + (ChunkNext ? Rand.Range(0,5) : 0.f); i < ChunkEnd; i += Rand.Range(1,10))
+				AddRandomPlanet(Rand, i);
+			ChunkPlanetCounts.push_back(Planets.Size() - CountBefore);
+			ChunkNext++;
+		}
+
+		if (Pos.z > EndlessRebaseDistance)
+		{
+			Origin += EndlessRebaseDistance;
+			Pos.z -= EndlessRebaseDistance;
+			for (std::vector<float>::iterator it = Planets.Z.begin(); it != Planets.Z.end(); ++it) *it -= EndlessRebaseDistance;
+		}
+		return Removed;
+	}
+
+	static int ShiftIndex(int Index, int Removed) { return (Index < Removed ? -1 : Index - Removed); }
+
+	double GetTraveledDistance() const { return Origin + Pos.z; }
+
+	//With ReturnToRoute set an off-route ship flies back diagonally to the center line, otherwise it gets snapped onto it
+	void AdvanceToGoal(bool ReturnToRoute)
+	{
+		const float AxisDistSq = Pos.x*Pos.x + Pos.y*Pos.y;
+		if (AxisDistSq > 0.5f && ReturnToRoute)
+		{
+			Dir = sSimVec3(-Dir.x, -Dir.y, Dir.z);
+			const float AxisDist = sqrtf(AxisDistSq);
+			const float Dot = (Dir.x * -Pos.x + Dir.y * -Pos.y) / AxisDist;
+			Distance = AxisDist / (Dot > 0.01f ? Dot : 1.f);
+		}
+		else
+		{
+			Pos = sSimVec3(0, 0, Pos.z);
+			Dir = sSimVec3(0, 0, 1);
+			Distance = (Endless ? 1.e30f : Params.GoalDistance - Pos.z);
+		}
+	}
+
+	float GetDrainFactor(const sSimVec3& d) const
+	{
+		return sSimVec3(d.x * Params.TravelDrainFactor, d.y * Params.TravelDrainFactor, d.z).GetLength();
+	}
+
+	//Distance moved in Seconds of game time, the ship flies twice as fast while traveling to a planet
+	float GetStepMove(float Seconds) const
+	{
+		return Seconds * 2.f * (TravelPlanet >= 0 ? 2.f : 1.f);
+	}
+
+	//Moves the ship by up to MoveAmount units along its current direction and resolves landing, losing and winning
+	eSimEvent Step(float MoveAmount)
+	{
+		const float DrainFactor = GetDrainFactor(Dir);
+		float MoveDistance = MoveAmount;
+		if (MoveDistance > Power / DrainFactor) MoveDistance = Power / DrainFactor;
+		if (MoveDistance > Distance) MoveDistance = Distance;
+		Pos = Pos + Dir * MoveDistance;
+		Distance -= MoveDistance;
+		Power -= MoveDistance * DrainFactor;
+		if (Distance <= SimSmallNumber) Distance = 0;
+		if (!Distance && TravelPlanet >= 0)
+		{
+			LandedPlanet = TravelPlanet;
+			sSimPlanetInfo& p = Planets.Info[LandedPlanet];
+			Power += p.GainByPower - p.LoseByEnemy;
+			Power = (Power < 0 ? 0 : (Power > Params.PowerStart ? Params.PowerStart : Power));
+			p.Cleared = true;
+			return SIMEVENT_LANDED;
+		}
+		if (Power <= SimSmallNumber)
+		{
+			Power = 0;
+			return SIMEVENT_LOSE;
+		}
+		if (!Distance)
+		{
+			AdvanceToGoal(false);
+			if (Distance < .2f) return SIMEVENT_WIN;
+		}
+		return SIMEVENT_NONE;
+	}
+
+	//Route and drain cost of a round trip to a planet, as shown on the scan menu
+	sSimTravel CalcTravel(int Planet) const
+	{
+		return CalcTravelFrom(Pos, Planets.GetPos(Planet), Planets.Radius[Planet], Params.TravelDrainFactor);
+	}
+
+	//Same for a trip starting at From, usable without a simulation instance
+	static sSimTravel CalcTravelFrom(const sSimVec3& From, const sSimVec3& PlanetPos, float Radius, float DrainFactor)
+	{
+		const sSimVec3 TravelTarget = PlanetPos + sSimVec3(0, (PlanetPos.y < 0 ? Radius : -Radius), -Radius - .2f);
+		const sSimVec3 TravelDelta = TravelTarget - From;
+		sSimTravel t;
+		t.Distance = TravelDelta.GetLength();
+		t.Dir = TravelDelta * (1.f / t.Distance);
+		const float TravelDrainTotal = sSimVec3(t.Dir.x * DrainFactor, t.Dir.y * DrainFactor, t.Dir.z).GetLength() * t.Distance * 2.f;
+		t.DrainExtra = TravelDrainTotal - ((TravelTarget.z - From.z) * 2.f);
+		return t;
+	}
+
+	//A planet can be picked for a visit while it is 3 to 35 units ahead
+	bool IsVisitable(int Planet) const
+	{
+		const float ZDist = Planets.Z[Planet] - Pos.z;
+		return (ZDist >= 3.f && ZDist <= 35.f && !Planets.Info[Planet].IsHome && !Planets.Info[Planet].Cleared);
+	}
+
+	//Index range [First, End) of the planets that can currently be picked for a visit (still need to check IsVisitable)
+	void VisitableRange(int& First, int& End) const
+	{
+		Planets.Range(Pos.z + 3.f, Pos.z + 35.f, First, End);
+	}
+
+	void Visit(int Planet)
+	{
+		const sSimTravel t = CalcTravel(Planet);
+		TravelPlanet = Planet;
+		Distance = t.Distance;
+		Dir = t.Dir;
+	}
+
+	void Abort()
+	{
+		LastTravelPlanet = TravelPlanet;
+		TravelPlanet = -1;
+		AdvanceToGoal(true);
+	}
+
+	void Continue()
+	{
+		AdvanceToGoal(true);
+		LastTravelPlanet = TravelPlanet;
+		TravelPlanet = -1;
+		LandedPlanet = -1;
+	}
+};
+
+#endif //_COSMICINFLUX_SIMULATION_
@@ -0,0 +1,168 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_SNAPSHOT_
+#define _COSMICINFLUX_SNAPSHOT_
+
+// Compact binary snapshot of a running game written field by field as little endian, so a killed process can resume it.
+// Any change to the stored data has to increase SNAPSHOT_VERSION, sSnapshotFile writes the snapshots in order on a job worker.
+
+#include "simulation.h"
+#include "jobs.h"
+#include <vector>
+#include <string.h>
+
+enum { SNAPSHOT_MAGIC = 0x4E534943, SNAPSHOT_VERSION = 2 }; //'CISN'
+
+struct sSnapshotWriter
+{
+	std::vector<unsigned char> Data;
+
+	void Put(unsigned int v) { const unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) }; Data.insert(Data.end(), b, b + 4); }
+	void Put(int v) { Put((unsigned int)v); }
+	void Put(bool v) { Data.push_back(v ? 1 : 0); }
+	void Put(float v) { unsigned int u; memcpy(&u, &v, 4); Put(u); }
+	void Put(double v) { unsigned long long u; memcpy(&u, &v, 8); Put((unsigned int)u); Put((unsigned int)(u >> 32)); }
+	void Put(const sSimVec3& v) { Put(v.x); Put(v.y); Put(v.z); }
+	void Put(const sSimParams& v) { Put(v.PowerStart); Put(v.GoalDistance); Put(v.TravelDrainFactor); }
+	void Put(const sSimPlanetInfo& v) { Put(v.ChancePower); Put(v.ChanceEnemy); Put(v.GainByPower); Put(v.LoseByEnemy); Put(v.IsHome); Put(v.Cleared); }
+
+	template <typename T> void PutVector(const std::vector<T>& v)
+	{
+		Put((unsigned int)v.size());
+		for (size_t i = 0; i < v.size(); i++) Put(v[i]);
+	}
+};
+
+//Reading past the end or an implausible count clears Ok, values read after that are left untouched
+struct sSnapshotReader
+{
+	const unsigned char *Cur, *End;
+	bool Ok;
+
+	sSnapshotReader(const void* Data, size_t Size) : Cur((const unsigned char*)Data), End((const unsigned char*)Data + Size), Ok(true) { }
+
+	bool Has(size_t Size) { if (Ok && (size_t)(End - Cur) >= Size) return true; Ok = false; return false; }
+	void Get(unsigned int& v) { if (!Has(4)) return; v = Cur[0] | (Cur[1] << 8) | (Cur[2] << 16) | ((unsigned int)Cur[3] << 24); Cur += 4; }
+	void Get(int& v) { unsigned int u = 0; if (!Has(4)) return; Get(u); v = (int)u; }
+	void Get(bool& v) { if (!Has(1)) return; v = (*Cur++ != 0); }
+	void Get(float& v) { unsigned int u = 0; if (!Has(4)) return; Get(u); memcpy(&v, &u, 4); }
+	void Get(double& v) { unsigned int Lo = 0, Hi = 0; if (!Has(8)) return; Get(Lo); Get(Hi); const unsigned long long u = Lo | ((unsigned long long)Hi << 32); memcpy(&v, &u, 8); }
+	void Get(sSimVec3& v) { Get(v.x); Get(v.y); Get(v.z); }
+	void Get(sSimParams& v) { Get(v.PowerStart); Get(v.GoalDistance); Get(v.TravelDrainFactor); }
+	void Get(sSimPlanetInfo& v) { Get(v.ChancePower); Get(v.ChanceEnemy); Get(v.GainByPower); Get(v.LoseByEnemy); Get(v.IsHome); Get(v.Cleared); }
+
+	template <typename T> void GetVector(std::vector<T>& v)
+	{
+		unsigned int Count = 0;
+		Get(Count);
+		if (!Ok || (size_t)(End - Cur) < Count) { Ok = false; v.clear(); return; } //every element takes at least a byte
+		v.resize(Count);
+		for (unsigned int i = 0; i < Count; i++) Get(v[i]);
+	}
+};
+
+static void WriteSimulation(sSnapshotWriter& w, const sSimulation& Sim)
+{
+	w.Put(Sim.Params);
+	w.PutVector(Sim.Planets.Z); w.PutVector(Sim.Planets.X); w.PutVector(Sim.Planets.Y); w.PutVector(Sim.Planets.Radius); w.PutVector(Sim.Planets.Info);
+	w.Put(Sim.Pos); w.Put(Sim.Dir); w.Put(Sim.Distance); w.Put(Sim.Power);
+	w.Put(Sim.TravelPlanet); w.Put(Sim.LandedPlanet); w.Put(Sim.LastTravelPlanet);
+	w.Put(Sim.Endless); w.Put(Sim.Seed); w.Put(Sim.Origin); w.Put(Sim.ChunkFirst); w.Put(Sim.ChunkNext);
+	w.PutVector(Sim.ChunkPlanetCounts);
+}
+
+static bool ReadSimulation(sSnapshotReader& r, sSimulation& Sim)
+{
+	r.Get(Sim.Params);
+	r.GetVector(Sim.Planets.Z); r.GetVector(Sim.Planets.X); r.GetVector(Sim.Planets.Y); r.GetVector(Sim.Planets.Radius); r.GetVector(Sim.Planets.Info);
+	r.Get(Sim.Pos); r.Get(Sim.Dir); r.Get(Sim.Distance); r.Get(Sim.Power);
+	r.Get(Sim.TravelPlanet); r.Get(Sim.LandedPlanet); r.Get(Sim.LastTravelPlanet);
+	r.Get(Sim.Endless); r.Get(Sim.Seed); r.Get(Sim.Origin); r.Get(Sim.ChunkFirst); r.Get(Sim.ChunkNext);
+	r.GetVector(Sim.ChunkPlanetCounts);
+	const int n = Sim.Planets.Size();
+	if (!r.Ok || (int)Sim.Planets.X.size() != n || (int)Sim.Planets.Y.size() != n || (int)Sim.Planets.Radius.size() != n || (int)Sim.Planets.Info.size() != n) return false;
+	return (Sim.TravelPlanet < n && Sim.LandedPlanet < n && Sim.LastTravelPlanet < n);
+}
+
+//Writes snapshot buffers with WriteFunc on a job worker, an empty buffer clears the file
+static struct sSnapshotFile
+{
+	typedef void (*WriteFileFunc)(const char* Path, const void* Data, size_t Size);
+	WriteFileFunc WriteFunc;
+	const char* Path;
+	std::vector<unsigned char> Pending, Writing;
+	bool HasPending, Queued;
+	#ifdef COSMIC_THREADS
+	std::mutex Mutex, WriteMutex; //WriteMutex is held from taking a buffer until it is written so writes can't overtake each other
+	#endif
+
+	sSnapshotFile() : WriteFunc(NULL), Path(NULL), HasPending(false), Queued(false) { }
+
+	//Takes over the contents of Data (it is left with the previous buffer to reuse)
+	void Write(std::vector<unsigned char>& Data)
+	{
+		{
+			#ifdef COSMIC_THREADS
+			std::lock_guard<std::mutex> Lock(Mutex);
+			#endif
+			Pending.swap(Data);
+			HasPending = true;
+			if (Queued) return;
+			Queued = true;
+		}
+		Jobs.Add(Job, this);
+	}
+
+	void Clear() { std::vector<unsigned char> Empty; Write(Empty); }
+
+	//Writes a waiting buffer on the calling thread and waits for a running write, call before the job system shuts down
+	void Flush() { WritePending(); }
+
+	static void Job(void* Data, int)
+	{
+		sSnapshotFile* f = (sSnapshotFile*)Data;
+		{
+			#ifdef COSMIC_THREADS
+			std::lock_guard<std::mutex> Lock(f->Mutex);
+			#endif
+			f->Queued = false;
+		}
+		f->WritePending();
+	}
+
+	void WritePending()
+	{
+		#ifdef COSMIC_THREADS
+		std::lock_guard<std::mutex> WriteLock(WriteMutex);
+		std::unique_lock<std::mutex> Lock(Mutex);
+		#endif
+		if (!HasPending) return;
+		Writing.swap(Pending);
+		HasPending = false;
+		#ifdef COSMIC_THREADS
+		Lock.unlock();
+		#endif
+		WriteFunc(Path, (Writing.empty() ? NULL : &Writing[0]), Writing.size());
+	}
+} SnapshotFile;
+
+#endif //_COSMICINFLUX_SNAPSHOT_
@@ -0,0 +1,90 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_STARFIELD_
+#define _COSMICINFLUX_STARFIELD_
+
+// Sky sphere texture generated once with the noise of the old sky shader, plus optional parallax star layers drawn as sprites.
+
+#include "planetbake.h"
+#include "simulation.h"
+
+enum { STARFIELD_WIDTH = 2048, STARFIELD_HEIGHT = 1024 };
+
+//Same as the old sky shader: clamp((snoise(texcoord*250.)-.95)*15.,0.,1.)
+struct sStarfieldBake : public sTextureBake
+{
+	sStarfieldBake() : sTextureBake(STARFIELD_WIDTH, STARFIELD_HEIGHT) { Start(); }
+
+	virtual void BakeRows(int RowFirst, int RowEnd)
+	{
+		const sF4 Zero(0.f), One(1.f), Freq(250.f), Threshold(.95f), Scale(15.f * 255.f);
+		float Lum[4];
+		for (int y = RowFirst; y < RowEnd; y++)
+		{
+			const sF4 v((y + .5f) / STARFIELD_HEIGHT * 250.f);
+			unsigned char* Out = &Pixels[y * STARFIELD_WIDTH * 4];
+			for (int x = 0; x < STARFIELD_WIDTH; x += 4, Out += 16)
+			{
+				const float u0 = (x + .5f) / STARFIELD_WIDTH, du = 1.f / STARFIELD_WIDTH;
+				const sF4 u = sF4(u0, u0 + du, u0 + du*2, u0 + du*3) * Freq;
+				sF4::Min(sF4::Max((sSimplexNoise::Noise4(u, v) - Threshold) * Scale, Zero), sF4(255.f)).Store(Lum);
+				for (int i = 0; i < 4; i++)
+					Out[i*4+0] = Out[i*4+1] = Out[i*4+2] = (unsigned char)(Lum[i] + .5f), Out[i*4+3] = 255;
+			}
+		}
+	}
+};
+
+//Stars scattered around the z axis that repeat every Depth units so the layer follows the player forever
+struct sStarLayer
+{
+	float Depth;
+	std::vector<sSimVec3> Stars;
+	std::vector<float> Brightness;
+
+	void Generate(unsigned int Seed, int Count, float MinDist, float MaxDist, float LayerDepth)
+	{
+		sSimRand Rand(Seed);
+		Depth = LayerDepth;
+		Stars.resize(Count);
+		Brightness.resize(Count);
+		for (int i = 0; i < Count; i++)
+		{
+			const float Angle = Rand.Range(0, 6.2831853f), Dist = Rand.Range(MinDist, MaxDist);
+			Stars[i] = sSimVec3(cosf(Angle) * Dist, sinf(Angle) * Dist, Rand.Range(0, Depth));
+			Brightness[i] = Rand.Range(.3f, 1.f);
+		}
+	}
+
+	//Position of star i in the repetition that lies in [ViewZ - Depth*.2, ViewZ + Depth*.8), Alpha fades it in at the far end
+	sSimVec3 GetPos(int i, float ViewZ, float& Alpha) const
+	{
+		float RelZ = fmodf(Stars[i].z - ViewZ + Depth * .2f, Depth);
+		if (RelZ < 0) RelZ += Depth;
+		RelZ -= Depth * .2f;
+		Alpha = (Depth * .8f - RelZ) / (Depth * .2f);
+		if (Alpha > 1.f) Alpha = 1.f;
+		return sSimVec3(Stars[i].x, Stars[i].y, ViewZ + RelZ);
+	}
+};
+
+#endif //_COSMICINFLUX_STARFIELD_
@@ -0,0 +1,241 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_TELEMETRY_
+#define _COSMICINFLUX_TELEMETRY_
+
+// Gameplay telemetry pushed by any thread into a lock-free ring and written compressed to rotating files by a background thread.
+// Tools/telemetry2csv turns the files into CSV, the record fields by type are listed there.
+
+#include "jobs.h"
+#include <atomic>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+enum eTelemetryType { TELEMETRY_RUN, TELEMETRY_SCAN, TELEMETRY_VISIT, TELEMETRY_IGNORE, TELEMETRY_ABORT, TELEMETRY_CONTINUE, TELEMETRY_LANDED, TELEMETRY_WIN, TELEMETRY_LOSE, TELEMETRY_FRAMES, TELEMETRY_TYPES };
+
+struct sTelemetryRecord
+{
+	unsigned short Type, Mode;
+	unsigned int Step; //simulation step in the run
+	int Planet;
+	float Power, Value[4];
+};
+
+//Files start with TELEMETRY_MAGIC and TELEMETRY_VERSION followed by chunks of record count, data size and the compressed records
+enum { TELEMETRY_MAGIC = 0x4C544943, TELEMETRY_VERSION = 1, TELEMETRY_RING = 4096, TELEMETRY_BATCH = 1024, TELEMETRY_FILES = 4, TELEMETRY_FILE_SIZE = 1 << 20 }; //TELEMETRY_RING must be a power of two
+
+//XOR with the previous record and run length encoding of the zero bytes (0 followed by run length - 1)
+static void TelemetryCompress(const sTelemetryRecord* Records, int Count, std::vector<unsigned char>& Out)
+{
+	Out.clear();
+	const unsigned char* p = (const unsigned char*)Records;
+	const int Size = Count * (int)sizeof(sTelemetryRecord);
+	for (int i = 0; i < Size;)
+	{
+		const unsigned char b = p[i] ^ (i >= (int)sizeof(sTelemetryRecord) ? p[i - sizeof(sTelemetryRecord)] : 0);
+		if (b) { Out.push_back(b); i++; continue; }
+		int Run = 1;
+		while (Run < 256 && i + Run < Size && p[i + Run] == (i + Run >= (int)sizeof(sTelemetryRecord) ? p[i + Run - sizeof(sTelemetryRecord)] : 0)) Run++;
+		Out.push_back(0);
+		Out.push_back((unsigned char)(Run - 1));
+		i += Run;
+	}
+}
+
+static bool TelemetryDecompress(const unsigned char* In, size_t InSize, int Count, std::vector<sTelemetryRecord>& Out)
+{
+	Out.resize(Count);
+	if (!Count) return !InSize;
+	unsigned char* p = (unsigned char*)&Out[0];
+	const size_t Size = Count * sizeof(sTelemetryRecord);
+	size_t i = 0;
+	for (size_t n = 0; n < InSize && i < Size; n++)
+	{
+		if (In[n]) { p[i++] = In[n]; continue; }
+		if (++n == InSize || i + In[n] + 1 > Size) return false;
+		for (int Run = In[n] + 1; Run > 0; Run--) p[i++] = 0;
+	}
+	if (i != Size) return false;
+	for (i = sizeof(sTelemetryRecord); i < Size; i++) p[i] ^= p[i - sizeof(sTelemetryRecord)];
+	return true;
+}
+
+static struct sTelemetry
+{
+	struct sSlot { std::atomic<unsigned int> Seq; sTelemetryRecord Record; };
+	sSlot Slots[TELEMETRY_RING];
+	std::atomic<unsigned int> Head; //next slot to push
+	unsigned int Tail; //next slot to read, only used by the writer
+	std::atomic<unsigned int> Dropped;
+	std::atomic<bool> Active;
+
+	std::string Path;
+	FILE* File;
+	long FileSize;
+	std::vector<sTelemetryRecord> Batch;
+	std::vector<unsigned char> Compressed;
+
+	#ifdef COSMIC_THREADS
+	std::thread Writer;
+	std::mutex Mutex;
+	std::condition_variable Signal;
+	bool Quit;
+	#else
+	float SinceFlush;
+	#endif
+
+	sTelemetry() : Head(0), Tail(0), Dropped(0), Active(false), File(NULL), FileSize(0)
+	{
+		for (unsigned int i = 0; i < TELEMETRY_RING; i++) Slots[i].Seq.store(i, std::memory_order_relaxed);
+		#ifdef COSMIC_THREADS
+		Quit = false;
+		#else
+		SinceFlush = 0;
+		#endif
+	}
+	~sTelemetry() { Shutdown(); }
+
+	//Starts a new log file (the older ones move one number up) and the writer
+	void Init(const char* BasePath)
+	{
+		if (Active) return;
+		Path = BasePath;
+		Batch.reserve(TELEMETRY_BATCH);
+		if (!Rotate()) return;
+		Active = true;
+		#ifdef COSMIC_THREADS
+		Quit = false;
+		Writer = std::thread(WriterMain, this);
+		#endif
+	}
+
+	//Writes what is left in the ring and closes the file
+	void Shutdown()
+	{
+		if (!Active) return;
+		Active = false;
+		#ifdef COSMIC_THREADS
+		{ std::lock_guard<std::mutex> Lock(Mutex); Quit = true; }
+		Signal.notify_one();
+		Writer.join();
+		#else
+		Flush();
+		#endif
+		if (File) fclose(File);
+		File = NULL;
+	}
+
+	//Lock-free, callable from any thread, drops the record if the ring is full
+	void Push(eTelemetryType Type, int Mode, unsigned int Step, int Planet, float Power, float V0 = 0, float V1 = 0, float V2 = 0, float V3 = 0)
+	{
+		if (!Active.load(std::memory_order_relaxed)) return;
+		unsigned int Pos = Head.load(std::memory_order_relaxed);
+		sSlot* s;
+		for (;;)
+		{
+			s = &Slots[Pos & (TELEMETRY_RING - 1)];
+			const int Diff = (int)(s->Seq.load(std::memory_order_acquire) - Pos);
+			if (Diff == 0 && Head.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed)) break;
+			if (Diff < 0) { Dropped.fetch_add(1, std::memory_order_relaxed); return; }
+			if (Diff > 0) Pos = Head.load(std::memory_order_relaxed);
+		}
+		sTelemetryRecord& r = s->Record;
+		r.Type = (unsigned short)Type; r.Mode = (unsigned short)Mode; r.Step = Step; r.Planet = Planet;
+		r.Power = Power; r.Value[0] = V0; r.Value[1] = V1; r.Value[2] = V2; r.Value[3] = V3;
+		s->Seq.store(Pos + 1, std::memory_order_release);
+	}
+
+	#ifndef COSMIC_THREADS
+	//Main thread without threads: writes a batch every few seconds
+	void Update(float Elapsed)
+	{
+		if (!Active || (SinceFlush += Elapsed) < 2.f) return;
+		SinceFlush = 0;
+		Flush();
+	}
+	#endif
+
+	#ifdef COSMIC_THREADS
+	static void WriterMain(sTelemetry* t)
+	{
+		std::unique_lock<std::mutex> Lock(t->Mutex);
+		while (!t->Quit)
+		{
+			t->Signal.wait_for(Lock, std::chrono::seconds(2));
+			Lock.unlock();
+			t->Flush();
+			Lock.lock();
+		}
+		Lock.unlock();
+		t->Flush();
+	}
+	#endif
+
+	//Writer: moves everything pushed so far into compressed chunks
+	void Flush()
+	{
+		for (;;)
+		{
+			Batch.clear();
+			while ((int)Batch.size() < TELEMETRY_BATCH)
+			{
+				sSlot& s = Slots[Tail & (TELEMETRY_RING - 1)];
+				if (s.Seq.load(std::memory_order_acquire) != Tail + 1) break;
+				Batch.push_back(s.Record);
+				s.Seq.store(Tail + TELEMETRY_RING, std::memory_order_release);
+				Tail++;
+			}
+			if (Batch.empty()) break;
+			WriteChunk();
+		}
+		if (File) fflush(File);
+	}
+
+	void WriteChunk()
+	{
+		if (!File || (FileSize >= TELEMETRY_FILE_SIZE && !Rotate())) return;
+		TelemetryCompress(&Batch[0], (int)Batch.size(), Compressed);
+		const unsigned int Header[2] = { (unsigned int)Batch.size(), (unsigned int)Compressed.size() };
+		fwrite(Header, sizeof(Header), 1, File);
+		fwrite(&Compressed[0], 1, Compressed.size(), File);
+		FileSize += (long)(sizeof(Header) + Compressed.size());
+	}
+
+	std::string FilePath(int Index) const { char Num[16]; sprintf(Num, ".%d", Index); return Path + Num; }
+
+	bool Rotate()
+	{
+		if (File) fclose(File);
+		remove(FilePath(TELEMETRY_FILES - 1).c_str());
+		for (int i = TELEMETRY_FILES - 1; i > 0; i--) rename(FilePath(i - 1).c_str(), FilePath(i).c_str());
+		File = fopen(FilePath(0).c_str(), "wb");
+		if (!File) return false;
+		const unsigned int Header[2] = { TELEMETRY_MAGIC, TELEMETRY_VERSION };
+		fwrite(Header, sizeof(Header), 1, File);
+		FileSize = sizeof(Header);
+		return true;
+	}
+} Telemetry;
+
+#endif //_COSMICINFLUX_TELEMETRY_
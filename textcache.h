@@ -0,0 +1,105 @@
+/*
+  Cosmic Influx
+  Copyright (C) 2017 Bernhard Schelling
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef _COSMICINFLUX_TEXTCACHE_
+#define _COSMICINFLUX_TEXTCACHE_
+
+// Texts with the shadow border rendered once per text and scale into a premultiplied alpha target, then drawn as a single quad.
+// Entries that were not drawn for a while are dropped again.
+
+#include <ZL_Display.h>
+#include <ZL_Font.h>
+#include <ZL_Surface.h>
+#include <map>
+
+struct sTextCache
+{
+	enum { PADDING = 2, SUPERSAMPLE = 2, EVICT_FRAMES = 120 };
+	struct sEntry { ZL_Surface Srf; ZL_Vector Size; unsigned int LastUsed; };
+	typedef std::map<std::pair<ZL_String, float>, sEntry> EntryMap;
+	EntryMap Entries;
+	ZL_TextBuffer Buffer;
+	unsigned int Frame;
+	int ShadowPasses; //8, 4 or 0 offset copies drawn for the shadow border
+
+	sTextCache() : Frame(0), ShadowPasses(8) { }
+
+	void Init(const ZL_Font& Font) { Buffer = ZL_TextBuffer(Font); Entries.clear(); }
+
+	//Cached texts get rendered again with the new number of shadow passes when they are drawn next
+	void SetShadowPasses(int Passes)
+	{
+		if (Passes == ShadowPasses) return;
+		ShadowPasses = Passes;
+		Entries.clear();
+	}
+
+	//Same look as drawing the text 8 times offset with half transparent black and then once in white (tinted by Color)
+	void Draw(const ZL_Vector& p, const char* Text, float Scale, ZL_Origin::Type Origin, const ZL_Color& Color)
+	{
+		sEntry& e = Entries[std::make_pair(ZL_String(Text), Scale)];
+		e.LastUsed = Frame;
+		if (!e.Srf)
+		{
+			Buffer.SetText(Text);
+			const float s = Scale * SUPERSAMPLE;
+			e.Size = Buffer.GetDimensions() * Scale;
+			const ZL_Vector Pos(PADDING * SUPERSAMPLE, PADDING * SUPERSAMPLE);
+			e.Srf = ZL_Surface((int)(e.Size.x * SUPERSAMPLE) + PADDING * SUPERSAMPLE * 2, (int)(e.Size.y * SUPERSAMPLE) + PADDING * SUPERSAMPLE * 2, true);
+			e.Srf.RenderToBegin(true);
+			ZL_Display::SetBlendModeSeparate(ZL_Display::BLEND_SRCALPHA, ZL_Display::BLEND_INVSRCALPHA, ZL_Display::BLEND_ONE, ZL_Display::BLEND_INVSRCALPHA); //alpha adds up like the shadow passes on screen
+			if (ShadowPasses) for (int i = -4; i <= 4; i += (ShadowPasses >= 8 ? 1 : 2)) if (i) Buffer.Draw(Pos + ZLV(i/3, i%3) * SUPERSAMPLE, s, ZLLUMA(0,.5), ZL_Origin::BottomLeft);
+			Buffer.Draw(Pos, s, ZL_Color::White, ZL_Origin::BottomLeft);
+			ZL_Display::ResetBlendFunc();
+			e.Srf.RenderToEnd();
+			e.Srf.SetScale(1.f / SUPERSAMPLE);
+		}
+		float ox = 0, oy = 0; //origin as fraction of the text size
+		switch (Origin)
+		{
+			case ZL_Origin::Center:       ox = .5f; oy = .5f; break;
+			case ZL_Origin::BottomCenter: ox = .5f; break;
+			case ZL_Origin::BottomRight:  ox = 1.f; break;
+			case ZL_Origin::TopLeft:      oy = 1.f; break;
+			case ZL_Origin::TopCenter:    ox = .5f; oy = 1.f; break;
+			case ZL_Origin::TopRight:     ox = 1.f; oy = 1.f; break;
+			case ZL_Origin::CenterLeft:   oy = .5f; break;
+			case ZL_Origin::CenterRight:  ox = 1.f; oy = .5f; break;
+			default: break;
+		}
+		ZL_Display::SetBlendFunc(ZL_Display::BLEND_ONE, ZL_Display::BLEND_INVSRCALPHA); //the target is premultiplied
+		e.Srf.Draw(p.x - e.Size.x * ox - PADDING, p.y - e.Size.y * oy - PADDING, ZL_Color(Color.r * Color.a, Color.g * Color.a, Color.b * Color.a, Color.a)); //tint premultiplied as well
+		ZL_Display::ResetBlendFunc();
+	}
+
+	//Call once per frame, drops entries not drawn in the last EVICT_FRAMES frames (i.e. numbers that changed)
+	void EndFrame()
+	{
+		if ((++Frame % EVICT_FRAMES) != 0) return;
+		for (EntryMap::iterator it = Entries.begin(); it != Entries.end();)
+		{
+			if (Frame - it->second.LastUsed > EVICT_FRAMES) Entries.erase(it++);
+			else ++it;
+		}
+	}
+};
+
+#endif //_COSMICINFLUX_TEXTCACHE_